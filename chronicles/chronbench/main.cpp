@@ -0,0 +1,412 @@
+// chronbench, encoder benchmark and quality harness
+// runs the encoder over a fixed procedurally generated corpus and emits per-image results as JSON
+//
+// usage: chronbench [-out file.json] [-iterations n] [-size WxH] [-dither none|bayer|fs|sierra] [-strength f]
+//    times are the fastest of n iterations (default 5) for each stage: histogram, reduce, map and write (SCF serialize)
+//    error is the mean CIE76 delta E between the source and the decoded encode, over opaque pixels
+
+#include "app.h"
+#include "chronwin.h"
+#include "ega.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+
+struct BenchConfig {
+   StringView outPath = "bench.json";
+   u32 iterations = 5;
+   Int2 size = { 640, 400 };
+   EGAEncodeOptions options;
+};
+
+struct BenchImage {
+   std::string name;
+   Texture *tex = nullptr;
+   EGAPalette target;
+};
+
+struct BenchResult {
+   Microseconds histogram = 0, reduce = 0, map = 0, write = 0, total = 0;
+   f64 meanDeltaE = 0.0;
+   bool success = false;
+};
+
+static Microseconds _now() {
+   using namespace std::chrono;
+   return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#pragma region CORPUS
+
+// corpus has to be identical between runs so everything is seeded
+struct Rng {
+   u32 state;
+};
+
+static u32 _rngNext(Rng &rng) {
+   rng.state ^= rng.state << 13;
+   rng.state ^= rng.state >> 17;
+   rng.state ^= rng.state << 5;
+   return rng.state;
+}
+
+static byte _toByte(f32 f) {
+   return (byte)MIN(255.0f, MAX(0.0f, f * 255.0f + 0.5f));
+}
+
+// smooth value noise in [0, 1] over a lattice of the given cell size
+static f32 _valueNoise(u32 seed, f32 x, f32 y) {
+   auto lattice = [=](i32 ix, i32 iy) {
+      u32 h = (u32)ix * 374761393u + (u32)iy * 668265263u + seed * 2246822519u;
+      h = (h ^ (h >> 13)) * 1274126177u;
+      return ((h ^ (h >> 16)) & 0xFFFF) / 65535.0f;
+   };
+
+   auto ix = (i32)floorf(x), iy = (i32)floorf(y);
+   auto fx = x - ix, fy = y - iy;
+   fx = fx * fx * (3 - 2 * fx);
+   fy = fy * fy * (3 - 2 * fy);
+
+   auto top = lattice(ix, iy) + (lattice(ix + 1, iy) - lattice(ix, iy)) * fx;
+   auto bottom = lattice(ix, iy + 1) + (lattice(ix + 1, iy + 1) - lattice(ix, iy + 1)) * fx;
+   return top + (bottom - top) * fy;
+}
+
+static f32 _fbm(u32 seed, f32 x, f32 y) {
+   f32 out = 0.0f, amp = 0.5f;
+   for (u32 i = 0; i < 5; ++i) {
+      out += _valueNoise(seed + i, x, y) * amp;
+      x *= 2.0f;
+      y *= 2.0f;
+      amp *= 0.5f;
+   }
+   return out;
+}
+
+typedef std::function<ColorRGBA(i32 x, i32 y)> PixelFn;
+
+static Texture *_generate(Int2 size, PixelFn const &fn) {
+   std::vector<ColorRGBA> pixels(size.x * size.y);
+   for (i32 y = 0; y < size.y; ++y) {
+      for (i32 x = 0; x < size.x; ++x) {
+         pixels[y * size.x + x] = fn(x, y);
+      }
+   }
+
+   auto out = textureCreateCustom(size.x, size.y, { RepeatType_CLAMP, FilterType_NEAREST });
+   textureSetPixels(out, (byte*)pixels.data());
+   return out;
+}
+
+static void _openPalette(EGAPalette &pal) {
+   memset(pal.colors, EGA_COLOR_UNDEFINED, EGA_PALETTE_COLORS);
+}
+
+static std::vector<BenchImage> _buildCorpus(Int2 size) {
+   std::vector<BenchImage> out;
+   auto w = (f32)size.x, h = (f32)size.y;
+
+   auto add = [&](StringView name, PixelFn const &fn) -> BenchImage& {
+      BenchImage img;
+      img.name = name;
+      img.tex = _generate(size, fn);
+      _openPalette(img.target);
+      out.push_back(img);
+      return out.back();
+   };
+
+   add("gradient_horizontal", [=](i32 x, i32 y) {
+      auto t = x / w;
+      return ColorRGBA{ _toByte(t), _toByte(1.0f - t), _toByte(y / h), 255 };
+   });
+
+   add("gradient_radial", [=](i32 x, i32 y) {
+      auto dx = x / w - 0.5f, dy = y / h - 0.5f;
+      auto d = MIN(1.0f, sqrtf(dx * dx + dy * dy) * 2.0f);
+      return ColorRGBA{ _toByte(1.0f - d), _toByte(0.6f * (1.0f - d) + 0.2f), _toByte(d), 255 };
+   });
+
+   Rng rng = { 0x2545F491 };
+   add("noise_white", [&](i32, i32) {
+      auto c = _rngNext(rng);
+      return ColorRGBA{ (byte)c, (byte)(c >> 8), (byte)(c >> 16), 255 };
+   });
+
+   add("noise_value", [=](i32 x, i32 y) {
+      return ColorRGBA{
+         _toByte(_fbm(1, x / 64.0f, y / 64.0f)),
+         _toByte(_fbm(2, x / 64.0f, y / 64.0f)),
+         _toByte(_fbm(3, x / 64.0f, y / 64.0f)), 255 };
+   });
+
+   // sky, sun and layered hills with noisy shading
+   add("photo_landscape", [=](i32 x, i32 y) {
+      auto u = x / w, v = y / h;
+      f32 r = 0.35f + 0.4f * v, g = 0.55f + 0.3f * v, b = 0.95f - 0.2f * v;
+
+      auto sx = u - 0.75f, sy = v - 0.25f;
+      auto sun = expf(-(sx * sx + sy * sy) * 80.0f);
+      r += sun; g += sun * 0.9f; b += sun * 0.5f;
+
+      for (u32 layer = 0; layer < 3; ++layer) {
+         auto ridge = 0.45f + layer * 0.15f + (_fbm(10 + layer, u * 4.0f, layer * 3.0f) - 0.5f) * 0.3f;
+         if (v > ridge) {
+            auto shade = 0.6f + 0.4f * _fbm(20 + layer, u * 32.0f, v * 32.0f) - layer * 0.1f;
+            r = (0.2f + layer * 0.1f) * shade;
+            g = (0.45f - layer * 0.08f) * shade;
+            b = (0.15f + layer * 0.02f) * shade;
+         }
+      }
+
+      return ColorRGBA{ _toByte(r), _toByte(g), _toByte(b), 255 };
+   });
+
+   // lit spheres over a wall, lots of smooth shading and some cutout transparency
+   add("photo_still_life", [=](i32 x, i32 y) {
+      auto u = x / w, v = y / h;
+      auto wall = 0.5f + 0.2f * _fbm(30, u * 16.0f, v * 16.0f);
+      f32 r = wall * 0.8f, g = wall * 0.7f, b = wall * 0.6f;
+
+      static const f32 spheres[3][6] = {
+         { 0.25f, 0.55f, 0.18f,  0.9f, 0.2f, 0.15f },
+         { 0.55f, 0.6f,  0.15f,  0.2f, 0.7f, 0.3f },
+         { 0.8f,  0.5f,  0.12f,  0.3f, 0.35f, 0.9f },
+      };
+
+      for (auto &s : spheres) {
+         auto dx = (u - s[0]) * w / h, dy = v - s[1];
+         auto d2 = (dx * dx + dy * dy) / (s[2] * s[2]);
+         if (d2 < 1.0f) {
+            auto nz = sqrtf(1.0f - d2);
+            auto light = MAX(0.0f, (-dx / s[2]) * -0.5f + (-dy / s[2]) * 0.5f + nz * 0.7f);
+            auto spec = powf(light, 24.0f);
+            r = s[3] * light + spec;
+            g = s[4] * light + spec;
+            b = s[5] * light + spec;
+         }
+      }
+
+      byte a = (u < 0.05f || u > 0.95f) ? 0 : 255;
+      return ColorRGBA{ _toByte(r), _toByte(g), _toByte(b), a };
+   });
+
+   // pixel art drawn only from a known palette, encoded against that palette locked and left open
+   EGAPalette known = { 0, 1, 2, 4, 6, 20, 7, 56, 57, 58, 60, 62, 63, 38, 27, 45 };
+   auto pixelArt = [=](i32 x, i32 y) {
+      auto tx = x / 8, ty = y / 8;
+      u32 h = (u32)tx * 73856093u ^ (u32)ty * 19349663u;
+      h = (h ^ (h >> 13)) * 1274126177u;
+      auto idx = ((h >> 8) + ((x & 7) < (y & 7) ? 1 : 0)) % EGA_PALETTE_COLORS;
+      auto c = egaGetColor(known.colors[idx]);
+      return ColorRGBA{ c.r, c.g, c.b, 255 };
+   };
+
+   add("pixelart_open", pixelArt);
+   add("pixelart_locked", pixelArt).target = known;
+
+   return out;
+}
+
+#pragma endregion
+
+#pragma region QUALITY
+
+static f32 _srgbToLinear(byte c) {
+   auto f = c / 255.0f;
+   return f <= 0.04045f ? f / 12.92f : powf((f + 0.055f) / 1.055f, 2.4f);
+}
+
+static f32 _labF(f32 t) {
+   return t > 0.008856f ? cbrtf(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+// D65 white
+static Float3 _toLab(ColorRGBA const &c) {
+   auto r = _srgbToLinear(c.r), g = _srgbToLinear(c.g), b = _srgbToLinear(c.b);
+   auto x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+   auto y = (0.2126f * r + 0.7152f * g + 0.0722f * b);
+   auto z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+
+   auto fx = _labF(x), fy = _labF(y), fz = _labF(z);
+   return { 116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz) };
+}
+
+static f64 _meanDeltaE(Texture *source, EGATexture *ega, EGAPalette *palette) {
+   auto size = textureGetSize(source);
+   auto decoded = textureCreateCustom(size.x, size.y, { RepeatType_CLAMP, FilterType_NEAREST });
+   egaTextureDecode(ega, decoded, palette);
+
+   auto a = textureGetPixels(source);
+   auto b = textureGetPixels(decoded);
+
+   f64 total = 0.0;
+   u64 count = 0;
+   for (i32 i = 0; i < size.x * size.y; ++i) {
+      if (a[i].a != 255) {
+         continue;
+      }
+
+      auto la = _toLab(a[i]), lb = _toLab(b[i]);
+      auto dl = la.x - lb.x, da = la.y - lb.y, db = la.z - lb.z;
+      total += sqrt(dl * dl + da * da + db * db);
+      ++count;
+   }
+
+   textureDestroy(decoded);
+   return count ? total / count : 0.0;
+}
+
+#pragma endregion
+
+static BenchResult _runImage(BenchConfig const &config, BenchImage &img) {
+   BenchResult out;
+   out.histogram = out.reduce = out.map = out.write = out.total = ~0ull;
+
+   for (u32 i = 0; i < config.iterations; ++i) {
+      EGAEncodeStats stats = { 0 };
+      auto options = config.options;
+      options.stats = &stats;
+
+      EGAPalette target = img.target, result = { 0 };
+      auto t0 = _now();
+      auto ega = egaTextureCreateFromTextureEncode(img.tex, &target, &result, &options);
+      auto t1 = _now();
+
+      if (!ega) {
+         return BenchResult();
+      }
+
+      byte *buff = nullptr;
+      u64 size = 0;
+      egaTextureSerialize(ega, &buff, &size);
+      delete[] buff;
+      auto t2 = _now();
+
+      out.histogram = MIN(out.histogram, stats.histogram);
+      out.reduce = MIN(out.reduce, stats.reduce);
+      out.map = MIN(out.map, stats.map);
+      out.write = MIN(out.write, t2 - t1);
+      out.total = MIN(out.total, t1 - t0);
+
+      // quality doesn't change between iterations
+      if (i == 0) {
+         out.meanDeltaE = _meanDeltaE(img.tex, ega, &result);
+      }
+
+      egaTextureDestroy(ega);
+   }
+
+   out.success = true;
+   return out;
+}
+
+static bool _writeJSON(BenchConfig const &config, std::vector<BenchImage> const &corpus, std::vector<BenchResult> const &results) {
+   static const StringView ditherNames[EGADither_COUNT] = { "none", "bayer", "fs", "sierra" };
+
+   auto f = fopen(config.outPath, "w");
+   if (!f) {
+      return false;
+   }
+
+   fprintf(f, "{\n");
+   fprintf(f, "  \"width\": %d,\n  \"height\": %d,\n  \"iterations\": %u,\n", config.size.x, config.size.y, config.iterations);
+   fprintf(f, "  \"dither\": \"%s\",\n  \"dither_strength\": %.3f,\n", ditherNames[config.options.dither], config.options.ditherStrength);
+   fprintf(f, "  \"peak_memory_bytes\": %llu,\n", (unsigned long long)processPeakMemory());
+   fprintf(f, "  \"images\": [\n");
+
+   for (u32 i = 0; i < corpus.size(); ++i) {
+      auto &r = results[i];
+      fprintf(f, "    { \"name\": \"%s\", \"success\": %s, \"histogram_us\": %llu, \"reduce_us\": %llu, \"map_us\": %llu, "
+         "\"write_us\": %llu, \"encode_us\": %llu, \"mean_delta_e\": %.4f }%s\n",
+         corpus[i].name.c_str(), r.success ? "true" : "false",
+         (unsigned long long)r.histogram, (unsigned long long)r.reduce, (unsigned long long)r.map,
+         (unsigned long long)r.write, (unsigned long long)r.total, r.meanDeltaE,
+         i + 1 < corpus.size() ? "," : "");
+   }
+
+   fprintf(f, "  ]\n}\n");
+   fclose(f);
+   return true;
+}
+
+static bool _parseArgs(int argc, char** argv, BenchConfig &config) {
+   static const StringView ditherNames[EGADither_COUNT] = { "none", "bayer", "fs", "sierra" };
+
+   auto begin = argv + 1;
+   auto end = argv + argc;
+
+   for (auto arg = begin; arg < end; ++arg) {
+      if (!strcmp(*arg, "-out") && ++arg < end) {
+         config.outPath = *arg;
+      }
+      else if (!strcmp(*arg, "-iterations") && ++arg < end) {
+         config.iterations = MAX(1, atoi(*arg));
+      }
+      else if (!strcmp(*arg, "-size") && ++arg < end) {
+         if (sscanf(*arg, "%dx%d", &config.size.x, &config.size.y) != 2 || config.size.x <= 0 || config.size.y <= 0) {
+            return false;
+         }
+      }
+      else if (!strcmp(*arg, "-dither") && ++arg < end) {
+         u32 i = 0;
+         while (i < EGADither_COUNT && strcmp(*arg, ditherNames[i])) { ++i; }
+         if (i == EGADither_COUNT) {
+            return false;
+         }
+         config.options.dither = (EGADither)i;
+      }
+      else if (!strcmp(*arg, "-strength") && ++arg < end) {
+         config.options.ditherStrength = (f32)atof(*arg);
+      }
+      else {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+int main(int argc, char** argv) {
+   BenchConfig config;
+   if (!_parseArgs(argc, argv, config)) {
+      fprintf(stderr, "usage: chronbench [-out file.json] [-iterations n] [-size WxH] [-dither none|bayer|fs|sierra] [-strength f]\n");
+      return 1;
+   }
+
+   egaStartup();
+
+   auto corpus = _buildCorpus(config.size);
+   std::vector<BenchResult> results;
+
+   for (auto &img : corpus) {
+      auto r = _runImage(config, img);
+      printf("%-20s hist %8.2fms  reduce %8.2fms  map %8.2fms  write %8.2fms  dE %7.3f %s\n", img.name.c_str(),
+         r.histogram / 1000.0, r.reduce / 1000.0, r.map / 1000.0, r.write / 1000.0, r.meanDeltaE,
+         r.success ? "" : "FAILED");
+      results.push_back(r);
+   }
+
+   for (auto &img : corpus) {
+      textureDestroy(img.tex);
+   }
+
+   printf("peak memory %.2fMB\n", processPeakMemory() / (1024.0 * 1024.0));
+
+   if (!_writeJSON(config, corpus, results)) {
+      fprintf(stderr, "failed to write '%s'\n", config.outPath);
+      return 1;
+   }
+
+   for (auto &r : results) {
+      if (!r.success) {
+         return 2;
+      }
+   }
+   return 0;
+}
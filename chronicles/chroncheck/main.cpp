@@ -0,0 +1,408 @@
+// chroncheck, hostile input checks for the formats the game loads
+// writes sample SCF documents in both formats and feeds every truncation and many bit-flipped copies
+// of them to scfValidate and scfViewChecked, then reads whatever they accept.
+// LZ blocks are round tripped, then their truncations and bit-flipped copies are decompressed
+//
+// usage: chroncheck [-iterations n] [-seed n]
+//    iterations is how many bit-flipped copies of each sample are tried (default 2000)
+//    truncations have to be rejected, anything accepted has to read back without a value pointing
+//    outside the document or writing past the output. Copies are allocated to their exact size so
+//    running under a debug heap or ASan also catches reads past the end that never return a pointer
+
+#include "scf.h"
+#include "lz.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+
+struct CheckConfig {
+   u32 iterations = 2000;
+   u32 seed = 1;
+};
+
+struct CheckResult {
+   u32 cases = 0, rejected = 0, failures = 0;
+};
+
+struct Rng {
+   u32 state;
+};
+
+static u32 _rngNext(Rng &rng) {
+   rng.state ^= rng.state << 13;
+   rng.state ^= rng.state >> 17;
+   rng.state ^= rng.state << 5;
+   return rng.state;
+}
+
+// exact size so anything read past the end is past the allocation too
+static byte *_copy(std::vector<byte> const &src, u32 size) {
+   auto out = (byte*)malloc(MAX(size, 1u));
+   memcpy(out, src.data(), size);
+   return out;
+}
+
+static void _fail(CheckResult &result, StringView name, StringView what) {
+   if (result.failures++ < 20) {
+      fprintf(stderr, "%s: %s\n", name, what);
+   }
+}
+
+#pragma region SCF
+
+// every value type, nested lists with and without offset tables, a dict and deduplicated strings
+static std::vector<byte> _writeSample(SCFFormat format) {
+   auto writer = scfWriterCreate(format);
+
+   scfWriteInt(writer, 42);
+   scfWriteFloat(writer, 1.5f);
+   scfWriteString(writer, "chronicles");
+   byte bytes[37];
+   for (u32 i = 0; i < sizeof(bytes); ++i) {
+      bytes[i] = (byte)(i * 7);
+   }
+   scfWriteBytes(writer, bytes, sizeof(bytes));
+
+   scfWriteListBegin(writer, SCFListFlags_OFFSET_TABLE);
+   for (i32 i = 0; i < 8; ++i) {
+      scfWriteInt(writer, i);
+      scfWriteString(writer, i & 1 ? "odd" : "even");
+   }
+   scfWriteListBegin(writer);
+   scfWriteFloat(writer, -2.0f);
+   scfWriteListEnd(writer);
+   scfWriteListEnd(writer);
+
+   scfWriteDictBegin(writer);
+   static const StringView keys[] = { "palette", "ega", "map", "font", "a", "zz" };
+   for (u32 i = 0; i < LEN(keys); ++i) {
+      scfWriteDictKey(writer, keys[i]);
+      scfWriteInt(writer, (i32)i);
+   }
+   scfWriteDictKey(writer, "nested");
+   scfWriteListBegin(writer);
+   scfWriteString(writer, "chronicles");
+   scfWriteListEnd(writer);
+   scfWriteDictEnd(writer);
+
+   i16 shorts[9] = { 1, -2, 3, -4, 5, -6, 7, -8, 9 };
+   f32 floats[5] = { 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+   f64 doubles[3] = { 1.0, 2.0, 3.0 };
+   scfWriteArray(writer, SCFArrayType_I8, bytes, 5, 1);
+   scfWriteArray(writer, SCFArrayType_I16, shorts, LEN(shorts));
+   scfWriteArray(writer, SCFArrayType_F32, floats, LEN(floats));
+   scfWriteArray(writer, SCFArrayType_F64, doubles, LEN(doubles));
+
+   std::vector<byte> blob(600);
+   for (u32 i = 0; i < blob.size(); ++i) {
+      blob[i] = (byte)(i / 40);
+   }
+   scfWriteCompressed(writer, blob.data(), (u32)blob.size());
+
+   u32 size = 0;
+   auto data = (byte const*)scfWriterFinish(writer, &size);
+   std::vector<byte> out(data, data + size);
+   scfWriterDestroy(writer);
+   return out;
+}
+
+struct SCFBounds {
+   byte const *begin, *end;
+   bool escaped = false;
+};
+
+static void _inside(SCFBounds &bounds, void const *ptr, u64 size) {
+   auto p = (byte const*)ptr;
+   if (p < bounds.begin || p > bounds.end || size > (u64)(bounds.end - p)) {
+      bounds.escaped = true;
+   }
+}
+
+static const u32 SCFElementSize[SCFArrayType_COUNT] = { 1, 2, 4, 4, 8 };
+
+// reads every value of view, recording anything that points outside the document
+static void _readAll(SCFBounds &bounds, SCFReader view, u32 depth) {
+   if (scfReaderNull(view) || depth > 64) {
+      return;
+   }
+
+   while (!scfReaderAtEnd(view)) {
+      switch (scfReaderPeek(view)) {
+      case SCFType_INT: _inside(bounds, scfReadInt(view), sizeof(i32)); break;
+      case SCFType_FLOAT: _inside(bounds, scfReadFloat(view), sizeof(f32)); break;
+      case SCFType_STRING: {
+         auto str = scfReadString(view);
+         _inside(bounds, str, 1);
+         if (!bounds.escaped && !memchr(str, 0, bounds.end - (byte const*)str)) {
+            bounds.escaped = true;
+         }
+      }  break;
+      case SCFType_BYTES: {
+         u32 size = 0;
+         auto bytes = scfReadBytes(view, &size);
+         _inside(bounds, bytes, size);
+      }  break;
+      case SCFType_ARRAY: {
+         u32 count = 0;
+         SCFArrayType type = 0;
+         void const *elements = nullptr;
+         for (; type < SCFArrayType_COUNT && !elements; ++type) {
+            elements = scfReadArray(view, type, &count);
+         }
+         if (elements) {
+            _inside(bounds, elements, (u64)count * SCFElementSize[type - 1]);
+         }
+         else {
+            scfReaderSkip(view);
+         }
+      }  break;
+      case SCFType_COMPRESSED: {
+         auto size = scfReadCompressedSize(view);
+         std::vector<byte> buffer(MIN(size, 1u << 20));
+         if (!size || size > buffer.size() || !scfReadCompressed(view, buffer.data(), size)) {
+            scfReaderSkip(view);
+         }
+      }  break;
+      case SCFType_SUBLIST:
+         _readAll(bounds, scfReadList(view), depth + 1);
+         break;
+      case SCFType_DICT: {
+         auto dict = scfReadDict(view);
+         if (scfReaderNull(dict)) {
+            break;
+         }
+         // a dict that lost its key table reads as a plain list
+         auto count = scfReaderCount(dict);
+         for (u32 i = 0; i < count; ++i) {
+            auto key = scfDictKeyAt(dict, i);
+            if (!key) {
+               break;
+            }
+            _inside(bounds, key, 1);
+            if (bounds.escaped || !memchr(key, 0, bounds.end - (byte const*)key)) {
+               bounds.escaped = true;
+               return;
+            }
+            scfDictFind(dict, key);
+         }
+         _readAll(bounds, dict, depth + 1);
+      }  break;
+      default:
+         scfReaderSkip(view);
+         break;
+      }
+
+      if (bounds.escaped) {
+         return;
+      }
+   }
+}
+
+// false if the document was accepted and read something outside itself
+static bool _readDocument(byte const *doc, u32 size, bool *rejected) {
+   SCFBounds bounds = { doc, doc + size };
+
+   auto valid = scfValidate(doc, size);
+   if (valid) {
+      _readAll(bounds, scfView(doc), 0);
+   }
+
+   auto checked = scfViewChecked(doc, size);
+   _readAll(bounds, checked, 0);
+
+   *rejected = !valid && scfReaderNull(checked);
+   return !bounds.escaped;
+}
+
+static void _checkSCF(CheckConfig const &config, StringView name, std::vector<byte> const &sample, CheckResult &result) {
+   auto size = (u32)sample.size();
+
+   bool rejected = false;
+   auto doc = _copy(sample, size);
+   if (!scfValidate(doc, size) || !_readDocument(doc, size, &rejected) || rejected) {
+      _fail(result, name, "sample doesn't read back");
+   }
+   free(doc);
+
+   for (u32 len = 0; len < size; ++len) {
+      doc = _copy(sample, len);
+      ++result.cases;
+      if (!_readDocument(doc, len, &rejected) || !rejected) {
+         _fail(result, name, format("truncated to %u bytes and accepted", len).c_str());
+      }
+      result.rejected += rejected;
+      free(doc);
+   }
+
+   Rng rng = { config.seed };
+   for (u32 i = 0; i < config.iterations; ++i) {
+      doc = _copy(sample, size);
+      auto flips = 1 + _rngNext(rng) % 4;
+      for (u32 f = 0; f < flips; ++f) {
+         auto bit = _rngNext(rng) % (size * 8);
+         doc[bit / 8] ^= (byte)(1 << (bit % 8));
+      }
+
+      ++result.cases;
+      if (!_readDocument(doc, size, &rejected)) {
+         _fail(result, name, format("bit-flipped copy %u read outside the document", i).c_str());
+      }
+      result.rejected += rejected;
+      free(doc);
+   }
+}
+
+#pragma endregion
+
+#pragma region LZ
+
+// empty, tiny, runs, repeated text, incompressible noise and matches reaching back past the 64KB window
+static std::vector<std::vector<byte>> _lzSamples(u32 seed) {
+   std::vector<std::vector<byte>> out;
+   out.push_back({});
+   out.push_back({ 7 });
+   out.push_back(std::vector<byte>(5000, 0xAA));
+
+   static const char text[] = "the quick brown fox jumps over the lazy dog, ";
+   std::vector<byte> prose;
+   for (u32 i = 0; i < 4000; ++i) {
+      prose.push_back((byte)text[(i * 3 + i / 45) % (sizeof(text) - 1)]);
+   }
+   out.push_back(prose);
+
+   Rng rng = { seed };
+   std::vector<byte> noise(3000);
+   for (auto &b : noise) {
+      b = (byte)_rngNext(rng);
+   }
+   out.push_back(noise);
+
+   std::vector<byte> far(noise);
+   far.resize(70000, 0x11);
+   far.insert(far.end(), noise.begin(), noise.end());
+   out.push_back(far);
+   return out;
+}
+
+static const u32 LZGuard = 16;
+static const byte LZGuardByte = 0xCD;
+
+// decompresses into an exact size output followed by guard bytes, false if the guard was touched
+static bool _lzDecode(byte const *src, u32 srcSize, u32 dstSize, std::vector<byte> &dst, bool *accepted) {
+   dst.assign(dstSize + LZGuard, LZGuardByte);
+   *accepted = lzDecompress(src, srcSize, dst.data(), dstSize);
+   for (u32 i = 0; i < LZGuard; ++i) {
+      if (dst[dstSize + i] != LZGuardByte) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static void _checkLZ(CheckConfig const &config, std::vector<byte> const &sample, CheckResult &result) {
+   auto size = (u32)sample.size();
+   auto name = format("lz %u bytes", size);
+
+   std::vector<byte> compressed(lzCompressBound(size));
+   auto compressedSize = lzCompress(sample.data(), size, compressed.data(), (u32)compressed.size());
+   if (!compressedSize) {
+      _fail(result, name.c_str(), "didn't compress within lzCompressBound");
+      return;
+   }
+
+   bool accepted = false;
+   std::vector<byte> out;
+   auto block = _copy(compressed, compressedSize);
+   ++result.cases;
+   if (!_lzDecode(block, compressedSize, size, out, &accepted) || !accepted || (size && memcmp(out.data(), sample.data(), size))) {
+      _fail(result, name.c_str(), "doesn't round trip");
+   }
+
+   // the size has to match exactly either way
+   ++result.cases;
+   if (size && (!_lzDecode(block, compressedSize, size - 1, out, &accepted) || accepted)) {
+      _fail(result, name.c_str(), "decompressed into a smaller output");
+   }
+   ++result.cases;
+   if (!_lzDecode(block, compressedSize, size + 1, out, &accepted) || accepted) {
+      _fail(result, name.c_str(), "decompressed into a larger output");
+   }
+   free(block);
+
+   // a block ending on a match has an empty last sequence, so a prefix can still decode to the original
+   for (u32 len = 0; len < compressedSize; ++len) {
+      block = _copy(compressed, len);
+      ++result.cases;
+      if (!_lzDecode(block, len, size, out, &accepted) || (accepted && size && memcmp(out.data(), sample.data(), size))) {
+         _fail(result, name.c_str(), format("truncated to %u bytes and decoded wrong", len).c_str());
+      }
+      result.rejected += !accepted;
+      free(block);
+   }
+
+   Rng rng = { config.seed };
+   for (u32 i = 0; i < config.iterations; ++i) {
+      block = _copy(compressed, compressedSize);
+      auto flips = 1 + _rngNext(rng) % 4;
+      for (u32 f = 0; f < flips; ++f) {
+         auto bit = _rngNext(rng) % (compressedSize * 8);
+         block[bit / 8] ^= (byte)(1 << (bit % 8));
+      }
+
+      ++result.cases;
+      if (!_lzDecode(block, compressedSize, size, out, &accepted)) {
+         _fail(result, name.c_str(), format("bit-flipped copy %u wrote past the output", i).c_str());
+      }
+      result.rejected += !accepted;
+      free(block);
+   }
+}
+
+#pragma endregion
+
+static bool _parseArgs(int argc, char** argv, CheckConfig &config) {
+   auto begin = argv + 1;
+   auto end = argv + argc;
+
+   for (auto arg = begin; arg < end; ++arg) {
+      if (!strcmp(*arg, "-iterations") && ++arg < end) {
+         config.iterations = (u32)MAX(1, atoi(*arg));
+      }
+      else if (!strcmp(*arg, "-seed") && ++arg < end) {
+         config.seed = (u32)MAX(1, atoi(*arg));
+      }
+      else {
+         return false;
+      }
+   }
+   return true;
+}
+
+static void _report(StringView name, CheckResult const &result) {
+   printf("%-12s %6u cases  %6u rejected  %s\n", name, result.cases, result.rejected, result.failures ? "FAILED" : "ok");
+}
+
+int main(int argc, char** argv) {
+   CheckConfig config;
+   if (!_parseArgs(argc, argv, config)) {
+      fprintf(stderr, "usage: chroncheck [-iterations n] [-seed n]\n");
+      return 1;
+   }
+
+   CheckResult compact, wide;
+   _checkSCF(config, "scf compact", _writeSample(SCFFormat_COMPACT), compact);
+   _checkSCF(config, "scf wide", _writeSample(SCFFormat_WIDE), wide);
+   _report("scf compact", compact);
+   _report("scf wide", wide);
+
+   CheckResult lz;
+   for (auto &sample : _lzSamples(config.seed)) {
+      _checkLZ(config, sample, lz);
+   }
+   _report("lz", lz);
+
+   return compact.failures || wide.failures || lz.failures ? 2 : 0;
+}
@@ -0,0 +1,403 @@
+// chronenc, headless batch encoder
+// encodes a directory or wildcard of PNGs to EGA textures across every core
+//
+// usage: chronenc <dir | pattern> [-out dir] [-assets folder] [-palette name] [-colors c0,c1,...] [-threads n] [-shared]
+//                 [-dither none|bayer|fs|sierra] [-strength f] [-cache file] [-pack file]
+//    -palette  target palette by name out of the asset folder's pal.bin
+//    -colors   16 comma separated target entries, 0-63 locks a color, ? leaves it open, - marks it unused
+//              with neither, every entry is left open
+//    -shared   builds one palette for every image from their merged histograms
+//    -dither   bayer is ordered 8x8, fs is floyd-steinberg and sierra is sierra lite, -strength scales it (default 1)
+//    -cache    reuses results for unchanged images out of an encode cache file and updates it
+//    -pack     writes every texture and its palette under the image's name into one asset pack
+//              instead of loose .ega files
+
+#include "app.h"
+#include "assets.h"
+#include "chronwin.h"
+#include "ega.h"
+#include "jobs.h"
+#include "pack.h"
+#include "scf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <string>
+
+struct EncConfig {
+   StringView input = nullptr;
+   StringView outDir = ".";
+   StringView assetFolder = nullptr;
+   StringView paletteName = nullptr;
+   StringView colors = nullptr;
+   u32 threads = 0;
+   bool shared = false;
+   EGAEncodeOptions options;
+   StringView cachePath = nullptr;
+   StringView packPath = nullptr;
+};
+
+struct EncResult {
+   std::string path;
+   Int2 size = { 0 };
+   Microseconds loadTime = 0, encodeTime = 0, writeTime = 0;
+   bool success = false;
+
+   // held for the pack with -pack
+   EGATexture *ega = nullptr;
+   EGAPalette palette = { 0 };
+};
+
+static Microseconds _now() {
+   using namespace std::chrono;
+   return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool _parseDither(StringView name, EGADither &out) {
+   static const StringView names[EGADither_COUNT] = { "none", "bayer", "fs", "sierra" };
+   for (u32 i = 0; i < EGADither_COUNT; ++i) {
+      if (!strcmp(name, names[i])) {
+         out = (EGADither)i;
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool _parseArgs(int argc, char** argv, EncConfig &config) {
+   auto begin = argv + 1;
+   auto end = argv + argc;
+
+   for (auto arg = begin; arg < end; ++arg) {
+      if (!strcmp(*arg, "-out") && ++arg < end) {
+         config.outDir = *arg;
+      }
+      else if (!strcmp(*arg, "-assets") && ++arg < end) {
+         config.assetFolder = *arg;
+      }
+      else if (!strcmp(*arg, "-palette") && ++arg < end) {
+         config.paletteName = *arg;
+      }
+      else if (!strcmp(*arg, "-colors") && ++arg < end) {
+         config.colors = *arg;
+      }
+      else if (!strcmp(*arg, "-threads") && ++arg < end) {
+         config.threads = (u32)atoi(*arg);
+      }
+      else if (!strcmp(*arg, "-shared")) {
+         config.shared = true;
+      }
+      else if (!strcmp(*arg, "-dither") && ++arg < end) {
+         if (!_parseDither(*arg, config.options.dither)) {
+            return false;
+         }
+      }
+      else if (!strcmp(*arg, "-strength") && ++arg < end) {
+         config.options.ditherStrength = (f32)atof(*arg);
+      }
+      else if (!strcmp(*arg, "-cache") && ++arg < end) {
+         config.cachePath = *arg;
+      }
+      else if (!strcmp(*arg, "-pack") && ++arg < end) {
+         config.packPath = *arg;
+      }
+      else if (**arg != '-') {
+         config.input = *arg;
+      }
+      else {
+         return false;
+      }
+   }
+
+   return config.input != nullptr;
+}
+
+static bool _parseColors(StringView colors, EGAPalette &palOut) {
+   u32 count = 0;
+   auto c = colors;
+
+   while (*c && count < EGA_PALETTE_COLORS) {
+      if (*c == '?') {
+         palOut.colors[count++] = EGA_COLOR_UNDEFINED;
+         ++c;
+      }
+      else if (*c == '-') {
+         palOut.colors[count++] = EGA_COLOR_UNUSED;
+         ++c;
+      }
+      else {
+         char *numEnd = nullptr;
+         auto value = strtol(c, &numEnd, 10);
+         if (numEnd == c || value < 0 || value >= EGA_COLORS) {
+            return false;
+         }
+         palOut.colors[count++] = (EGAColor)value;
+         c = numEnd;
+      }
+
+      if (*c == ',') { ++c; }
+   }
+
+   return count == EGA_PALETTE_COLORS && !*c;
+}
+
+static bool _targetPalette(EncConfig const &config, EGAPalette &palOut) {
+   memset(palOut.colors, EGA_COLOR_UNDEFINED, EGA_PALETTE_COLORS);
+
+   if (config.paletteName) {
+      auto assets = assetsCreate(config.assetFolder);
+      auto pal = assetsPaletteRetrieve(assets, config.paletteName);
+      if (pal) {
+         palOut = *pal;
+      }
+      assetsDestroy(assets);
+
+      if (!pal) {
+         fprintf(stderr, "palette '%s' not found\n", config.paletteName);
+         return false;
+      }
+   }
+   else if (config.colors && !_parseColors(config.colors, palOut)) {
+      fprintf(stderr, "-colors needs 16 entries of 0-63, ? or -\n");
+      return false;
+   }
+
+   return true;
+}
+
+// output is an SCF document of [palette bytes, texture list]
+static bool _writeEGA(StringView path, EGATexture *ega, EGAPalette &palette) {
+   auto writer = scfWriterCreate();
+   scfWriteBytes(writer, palette.colors, sizeof(EGAPalette));
+   egaTextureWriteSCF(ega, writer);
+
+   u32 size = 0;
+   auto buff = (byte*)scfWriterFinish(writer, &size);
+   auto written = buff ? writeBinaryFile(path, buff, size) : 0;
+   scfWriterDestroy(writer);
+   return written != 0;
+}
+
+// writes the loose .ega or holds onto ega for the pack, takes ownership of ega
+static void _storeResult(EncConfig const &config, EncResult &result, EGATexture *ega, EGAPalette &palette) {
+   auto t0 = _now();
+   if (config.packPath) {
+      result.ega = ega;
+      result.palette = palette;
+      result.success = true;
+   }
+   else {
+      auto outPath = format("%s/%s.ega", config.outDir, pathGetFilename(result.path.c_str()).c_str());
+      result.success = _writeEGA(outPath.c_str(), ega, palette);
+      egaTextureDestroy(ega);
+   }
+   result.writeTime = _now() - t0;
+}
+
+static void _encodeFile(EncConfig const &config, EGAPalette const &target, EGAEncodeCache *cache, EncResult &result) {
+   auto t0 = _now();
+   auto png = textureCreateFromPath(result.path.c_str(), {});
+   auto t1 = _now();
+   result.loadTime = t1 - t0;
+
+   if (!png) {
+      return;
+   }
+
+   result.size = textureGetSize(png);
+
+   EGAPalette targetCopy = target, resultPal = { 0 };
+   auto ega = cache
+      ? egaEncodeCacheEncode(cache, png, &targetCopy, &resultPal, &config.options)
+      : egaTextureCreateFromTextureEncode(png, &targetCopy, &resultPal, &config.options);
+   auto t2 = _now();
+   result.encodeTime = t2 - t1;
+
+   textureDestroy(png);
+
+   if (!ega) {
+      return;
+   }
+
+   _storeResult(config, result, ega, resultPal);
+}
+
+// loads everything, encodes once against a merged histogram, then writes everything
+static Microseconds _encodeShared(EncConfig const &config, EGAPalette const &target, std::vector<EncResult> &results, JobPool *pool) {
+   auto count = (u32)results.size();
+   std::vector<Texture*> pngs(count, nullptr);
+   std::vector<EGATexture*> egas(count, nullptr);
+
+   jobPoolParallelFor(pool, count, 1, [&](u32 begin, u32 end) {
+      for (u32 i = begin; i < end; ++i) {
+         auto t0 = _now();
+         pngs[i] = textureCreateFromPath(results[i].path.c_str(), {});
+         results[i].loadTime = _now() - t0;
+         if (pngs[i]) {
+            results[i].size = textureGetSize(pngs[i]);
+         }
+      }
+   });
+
+   EGAPalette targetCopy = target, resultPal = { 0 };
+   auto t0 = _now();
+   egaTextureCreateFromTexturesEncode(pngs.data(), nullptr, count, &targetCopy, &resultPal, egas.data(), &config.options);
+   auto encodeTime = _now() - t0;
+
+   jobPoolParallelFor(pool, count, 1, [&](u32 begin, u32 end) {
+      for (u32 i = begin; i < end; ++i) {
+         if (pngs[i]) {
+            textureDestroy(pngs[i]);
+         }
+
+         if (egas[i]) {
+            _storeResult(config, results[i], egas[i], resultPal);
+         }
+      }
+   });
+
+   return encodeTime;
+}
+
+static bool _writePack(EncConfig const &config, std::vector<EncResult> &results) {
+   auto builder = assetPackBuilderCreate();
+   for (auto &r : results) {
+      if (r.ega) {
+         auto name = pathGetFilename(r.path.c_str());
+         assetPackBuilderAddTexture(builder, name.c_str(), r.ega);
+         assetPackBuilderAddPalette(builder, name.c_str(), r.palette);
+         egaTextureDestroy(r.ega);
+         r.ega = nullptr;
+      }
+   }
+
+   auto written = assetPackBuilderWrite(builder, config.packPath);
+   assetPackBuilderDestroy(builder);
+   return written;
+}
+
+static void _writeSummary(EncConfig const &config, std::vector<EncResult> const &results, Microseconds wallTime, u32 threads) {
+   auto csvPath = format("%s/encode_summary.csv", config.outDir);
+   auto csv = fopen(csvPath.c_str(), "w");
+   if (csv) {
+      fprintf(csv, "file,width,height,load_ms,encode_ms,write_ms,success\n");
+   }
+
+   Microseconds loadTotal = 0, encodeTotal = 0, writeTotal = 0;
+   u64 pixels = 0;
+   u32 succeeded = 0;
+
+   for (auto &r : results) {
+      printf("%-40s %5dx%-5d load %8.2fms  encode %8.2fms  write %8.2fms %s\n",
+         pathGetFilename(r.path.c_str()).c_str(), r.size.x, r.size.y,
+         r.loadTime / 1000.0, r.encodeTime / 1000.0, r.writeTime / 1000.0,
+         r.success ? "" : "FAILED");
+
+      if (csv) {
+         fprintf(csv, "\"%s\",%d,%d,%.3f,%.3f,%.3f,%d\n", r.path.c_str(), r.size.x, r.size.y,
+            r.loadTime / 1000.0, r.encodeTime / 1000.0, r.writeTime / 1000.0, r.success ? 1 : 0);
+      }
+
+      loadTotal += r.loadTime;
+      encodeTotal += r.encodeTime;
+      writeTotal += r.writeTime;
+      pixels += (u64)r.size.x * r.size.y;
+      succeeded += r.success ? 1 : 0;
+   }
+
+   if (csv) {
+      fclose(csv);
+   }
+
+   auto wallSecs = MAX(wallTime, 1) / 1000000.0;
+   printf("\n%u/%u images encoded on %u threads in %.3fs\n", succeeded, (u32)results.size(), threads, wallSecs);
+   printf("cpu time: load %.3fs, encode %.3fs, write %.3fs\n", loadTotal / 1000000.0, encodeTotal / 1000000.0, writeTotal / 1000000.0);
+   printf("%.2f images/s, %.2f Mpixels/s\n", results.size() / wallSecs, pixels / wallSecs / 1000000.0);
+}
+
+int main(int argc, char** argv) {
+   EncConfig config;
+   if (!_parseArgs(argc, argv, config)) {
+      fprintf(stderr, "usage: chronenc <dir | pattern> [-out dir] [-assets folder] [-palette name] [-colors c0,c1,...] [-threads n] [-shared] [-dither none|bayer|fs|sierra] [-strength f] [-cache file] [-pack file]\n");
+      return 1;
+   }
+
+   jobPoolGlobalSetThreadCount(config.threads);
+   egaStartup();
+
+   EGAPalette target;
+   if (!_targetPalette(config, target)) {
+      return 1;
+   }
+
+   auto pattern = pathIsDirectory(config.input) ? format("%s/*.png", config.input) : std::string(config.input);
+   auto files = pathListFiles(pattern.c_str());
+   if (files.empty()) {
+      fprintf(stderr, "no files match '%s'\n", pattern.c_str());
+      return 1;
+   }
+
+   std::vector<EncResult> results(files.size());
+   for (u32 i = 0; i < files.size(); ++i) {
+      results[i].path = files[i];
+   }
+
+   // the cache only covers per-image encodes, shared palettes depend on the whole set
+   EGAEncodeCache *cache = nullptr;
+   if (config.cachePath && !config.shared) {
+      cache = egaEncodeCacheCreate(config.cachePath);
+   }
+
+   if (!pathCreateDirectory(config.outDir)) {
+      fprintf(stderr, "failed to create output folder '%s'\n", config.outDir);
+      return 1;
+   }
+
+   // files run on the same pool the encoder fans out on so nested work shares the threads
+   auto pool = jobPoolGlobal();
+   auto threads = jobPoolThreadCount(pool);
+
+   auto start = _now();
+   Microseconds sharedEncodeTime = 0;
+   if (config.shared) {
+      sharedEncodeTime = _encodeShared(config, target, results, pool);
+   }
+   else {
+      jobPoolParallelFor(pool, (u32)results.size(), 1, [&](u32 begin, u32 end) {
+         for (u32 i = begin; i < end; ++i) {
+            _encodeFile(config, target, cache, results[i]);
+         }
+      });
+   }
+   auto wallTime = _now() - start;
+
+   _writeSummary(config, results, wallTime, threads);
+   if (config.shared) {
+      printf("shared palette encode: %.3fs\n", sharedEncodeTime / 1000000.0);
+   }
+
+   if (config.packPath && !_writePack(config, results)) {
+      fprintf(stderr, "failed to write asset pack '%s'\n", config.packPath);
+      return 2;
+   }
+
+   if (cache) {
+      auto stats = egaEncodeCacheGetStats(cache);
+      printf("encode cache: %u hits, %u misses, %u entries\n", stats.hits, stats.misses, stats.entries);
+
+      if (!egaEncodeCacheSave(cache)) {
+         fprintf(stderr, "failed to write encode cache '%s'\n", config.cachePath);
+      }
+      egaEncodeCacheDestroy(cache);
+   }
+
+   for (auto &r : results) {
+      if (!r.success) {
+         return 2;
+      }
+   }
+   return 0;
+}
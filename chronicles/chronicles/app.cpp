@@ -7,6 +7,7 @@
 
 #include "imgui_impl_sdl_gl3.h"
 #include "game.h"
+#include "loader.h"
 
 #include "math.h"
 
@@ -34,6 +35,9 @@ struct Window {
    std::unordered_map<std::string, Dialog> dlgs;
 };
 
+// time each frame gets for applying finished loads
+static const Microseconds LoadFrameBudget = 2000;
+
 struct App {
    bool running = false;
    Window* wnd = nullptr;
@@ -44,6 +48,7 @@ struct App {
 
 App* appCreate(AppConfig const& config) {
    auto out = new App();
+   saveQueueSetSync(saveQueueGlobal(), config.saveSync);
    out->game = gameCreate(config.assetFolder);
    return out;
 }
@@ -194,6 +199,12 @@ static void _pollEvents(App* app) {
    appPollEvents(app);
 }
 
+static void _applyLoads(App* app) {
+   auto data = gameData(app->game);
+   assetsPollChanges(data->assets);
+   loaderPump(data->loader, LoadFrameBudget);
+}
+
 static void _beginFrame(App* app) {
    ImGui_ImplSdlGL3_NewFrame(app->wnd->sdlWnd);
 }
@@ -237,6 +248,7 @@ static void _updateDialogs(App* app) {
 
 void appStep(App* app) {   
    _pollEvents(app);
+   _applyLoads(app);
    _beginFrame(app);
    _updateGame(app);
    _updateDialogs(app);
@@ -384,6 +396,19 @@ Texture *textureCreateFromPath(StringView path, TextureConfig const& config) {
 
    return out;
 }
+Texture *textureLoadFromPath(StringView path, TextureConfig const& config) {
+   int x = 0, y = 0, comps = 0;
+   auto data = stbi_load(path, &x, &y, &comps, 4);
+   if (!data) {
+      return NULL;
+   }
+
+   // custom textures only touch GL once they're drawn
+   auto out = textureCreateCustom(x, y, config);
+   textureSetPixels(out, data);
+   stbi_image_free(data);
+   return out;
+}
 Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag) {
    int x = 0, y = 0, comp = 0;
 
@@ -465,7 +490,8 @@ uPtr textureGetHandle(Texture *self) {
 }
 
 const ColorRGBA *textureGetPixels(Texture *self) {
-   if (!self->isLoaded) {
+   // textures that already have pixels don't need GL to read them
+   if (!self->pixels && !self->isLoaded) {
       _textureAcquire(self);
    }
    return self->pixels;
@@ -2,6 +2,7 @@
 
 #include "defs.h"
 #include "math.h"
+#include "save.h"
 
 #include <functional>
 
@@ -15,6 +16,7 @@
 
 struct AppConfig {
    const char* assetFolder = nullptr;
+   SaveSync saveSync = SaveSync_FILE;
 };
 
 // APP
@@ -77,6 +79,8 @@ enum {
 typedef byte TextureFromBufferFlag;
 
 Texture *textureCreateFromPath(StringView path, TextureConfig const& config);
+// decodes now instead of on first use, unlike the rest this is safe off the main thread
+Texture *textureLoadFromPath(StringView path, TextureConfig const& config);
 Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag = 0);
 Texture *textureCreateCustom(u32 width, u32 height, TextureConfig const& config);
 void textureDestroy(Texture *self);
@@ -0,0 +1,715 @@
+#include "assets.h"
+#include "chronwin.h"
+#include "scf.h"
+#include "egabind.h"
+#include "pack.h"
+#include "loader.h"
+#include "save.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Palettes are a base dict in pal.bin plus append-only journals of changes made since.
+// The base records its generation G and journals are pal.<gen>.journal, replayed from G up
+// while they exist. Compaction moves new appends to the next journal, writes that generation's
+// base off to the side and swaps it in, so a save is only ever one record appended.
+// Appends are only flushed to the OS, not synced: a crash of the app loses nothing but a power cut
+// can lose the journal's tail, which loads as torn and is dropped. Bases go through the SaveQueue
+// and get its SaveSync
+static const StringView PackPath = "assets.pack";
+static const StringView PalettePath = "pal.bin";
+static const StringView PaletteJournalPath = "pal.%u.journal";
+
+// journals compact past this or the size of the base, whichever is larger
+static const u64 PaletteJournalLimit = 64 * 1024;
+
+enum PaletteOp_ {
+   PaletteOp_PUT = 0,
+   PaletteOp_DELETE
+};
+typedef byte PaletteOp;
+
+// one journal entry, stored as [u32 size][SCF document] padded to 4 bytes
+struct PaletteRecord {
+   PaletteOp op = PaletteOp_PUT;
+   std::string name;
+   EGAPalette palette = {};
+};
+
+SCF_BIND(PaletteRecord, 
+   SCF_FIELD(PaletteRecord, op), 
+   SCF_FIELD(PaletteRecord, name), 
+   SCF_FIELD(PaletteRecord, palette));
+
+typedef std::vector<std::pair<std::string, EGAPalette>> PaletteSnapshot;
+
+struct Assets {
+   StringView assetsFolder = nullptr;
+
+   std::unordered_map<std::string, EGAPalette*> palettes;
+
+   // name index, built once when palettes finish loading and kept up to date after
+   std::vector<Symbol> names; // sorted
+   std::unordered_map<u32, std::vector<Symbol>> grams; // sorted names containing each 1 to 3 character run
+   bool indexed = false;
+
+   // last substring search, reused until the query or the names change
+   std::string lastSearch;
+   std::vector<Symbol> searchResults;
+   bool searchValid = false;
+
+   AssetPack *pack = nullptr;
+
+   Loader *loader = nullptr;
+   LoadHandle loading = 0; // palettes still loading
+   LoadHandle packLoading = 0;
+
+   // files changed by something else, reloaded on the loader
+   FileWatcher *watcher = nullptr;
+   bool paletteChanged = false; // waits on loading and compaction so our own writes can be told apart
+   bool packChanged = false;
+
+   SCFWriter *writer = nullptr; // kept around so repeated saves reuse its buffers
+
+   FILE *journal = nullptr; // opened on the first append
+   u32 journalGeneration = 0;
+   u64 journalSize = 0;
+   bool journalTorn = false; // loading stopped at a partial record, compacted before anything's appended
+
+   // owned by the base save while compacting is set
+   std::atomic<bool> compacting = { false };
+   u32 baseGeneration = 0;
+   u64 baseSize = 0;
+   u64 baseStamp = 0; // fileStamp of pal.bin as we last read or wrote it
+};
+
+static std::string _assetPath(Assets *assets, StringView path) {
+   return assets->assetsFolder ? format("%s/%s", assets->assetsFolder, path) : path;
+}
+static u64 _align4(u64 size) {
+   return (size + 3) & ~3ull;
+}
+static std::string _journalPath(Assets *assets, u32 generation) {
+   return _assetPath(assets, format(PaletteJournalPath, generation).c_str());
+}
+
+#pragma region Name Index
+
+static bool _nameLess(StringView lhs, StringView rhs) {
+   return strcmp(lhs, rhs) < 0;
+}
+// runs of up to 3 characters packed into one key, names never contain 0 so lengths can't collide
+static u32 _gram(StringView str, u32 len) {
+   u32 out = 0;
+   for (u32 i = 0; i < len; ++i) {
+      out |= (byte)str[i] << (i * 8);
+   }
+   return out;
+}
+
+// calls fn(key) for every run of 1 to 3 characters in name, repeats included
+template<typename Fn>
+static void _forEachGram(StringView name, Fn fn) {
+   for (auto c = name; *c; ++c) {
+      for (u32 len = 1; len <= 3 && c[len - 1]; ++len) {
+         fn(_gram(c, len));
+      }
+   }
+}
+
+// names are interned so equal names are equal pointers
+static void _sortedInsert(std::vector<Symbol> &list, Symbol name) {
+   auto at = std::lower_bound(list.begin(), list.end(), name, _nameLess);
+   if (at == list.end() || *at != name) {
+      list.insert(at, name);
+   }
+}
+static void _sortedErase(std::vector<Symbol> &list, Symbol name) {
+   auto at = std::lower_bound(list.begin(), list.end(), name, _nameLess);
+   if (at != list.end() && *at == name) {
+      list.erase(at);
+   }
+}
+
+static void _indexAdd(Assets *assets, StringView key) {
+   assets->searchValid = false;
+   if (!assets->indexed) {
+      return;
+   }
+
+   auto name = intern(key);
+   _sortedInsert(assets->names, name);
+   _forEachGram(name, [&](u32 gram) {
+      _sortedInsert(assets->grams[gram], name);
+   });
+}
+static void _indexRemove(Assets *assets, StringView key) {
+   assets->searchValid = false;
+   if (!assets->indexed) {
+      return;
+   }
+
+   auto name = intern(key);
+   _sortedErase(assets->names, name);
+   _forEachGram(name, [&](u32 gram) {
+      auto found = assets->grams.find(gram);
+      if (found != assets->grams.end()) {
+         _sortedErase(found->second, name);
+      }
+   });
+}
+
+// one sort instead of an insert per palette while loading
+static void _indexBuild(Assets *assets) {
+   auto &names = assets->names;
+   names.clear();
+   names.reserve(assets->palettes.size());
+   for (auto &p : assets->palettes) {
+      names.push_back(intern(p.first.c_str()));
+   }
+   std::sort(names.begin(), names.end(), _nameLess);
+
+   // walking names in order keeps every posting list sorted
+   assets->grams.clear();
+   for (auto name : names) {
+      _forEachGram(name, [&](u32 gram) {
+         auto &postings = assets->grams[gram];
+         if (postings.empty() || postings.back() != name) {
+            postings.push_back(name);
+         }
+      });
+   }
+
+   assets->indexed = true;
+   assets->searchValid = false;
+}
+
+#pragma endregion
+
+static void _loadPalette(Assets *assets, StringView key, EGAPalette const& value) {
+   if (auto existing = assetsPaletteRetrieve(assets, key)) {
+      *existing = value;
+   }
+   else {
+      EGAPalette *newPal = new EGAPalette;
+      *newPal = value;
+      assets->palettes.insert({ key, newPal });
+      _indexAdd(assets, key);
+   }
+}
+static void _unloadPalette(Assets *assets, StringView key) {
+   auto found = assets->palettes.find(key);
+   if (found != assets->palettes.end()) {
+      delete found->second;
+      assets->palettes.erase(found);
+      _indexRemove(assets, key);
+   }
+}
+
+// older files are a list of [name, bytes] pair lists instead of a dict
+static void _loadPalettesLegacy(Assets *assets, SCFReader view) {
+   while (!scfReaderAtEnd(view)) {
+      SCFReader kvp = scfReadList(view);
+      if (scfReaderNull(kvp)) {
+         break;
+      }
+
+      auto key = scfReadString(kvp);
+      if (!key) {
+         break;
+      }
+
+      EGAPalette value;
+      if (!scfRead(kvp, value)) {
+         break;
+      }
+
+      _loadPalette(assets, key, value);
+   }
+}
+
+// sets the base generation, files from before journaling don't have one and are 0.
+// Checked since other tools write pal.bin too, false if it's missing or damaged
+static bool _loadPaletteBase(Assets *assets) {
+   auto file = scfOpenFile(_assetPath(assets, PalettePath).c_str(), SCFAccess_SEQUENTIAL);
+   if (!file) {
+      return false;
+   }
+
+   auto view = scfFileViewChecked(file);
+   if (scfReaderNull(view)) {
+      scfCloseFile(file);
+      return false;
+   }
+
+   if (scfReaderPeek(view) == SCFType_DICT) {
+      auto dict = scfReadDict(view);
+      auto count = scfReaderCount(dict);
+
+      for (u32 i = 0; i < count; ++i) {
+         auto entry = scfDictValueAt(dict, i);
+         EGAPalette value;
+         if (scfRead(entry, value)) {
+            _loadPalette(assets, scfDictKeyAt(dict, i), value);
+         }
+      }
+
+      scfRead(view, assets->baseGeneration);
+   }
+   else {
+      _loadPalettesLegacy(assets, view);
+   }
+
+   assets->baseSize = scfFileSize(file);
+   scfCloseFile(file);
+   return true;
+}
+
+// applies every whole record, false if the file is missing
+// torn is set if it ends in a partial or corrupt record, which is everything past it
+static bool _replayJournal(Assets *assets, u32 generation, u64 *size, bool *torn) {
+   auto data = readFullFile(_journalPath(assets, generation).c_str(), size);
+   if (!data) {
+      return false;
+   }
+
+   u64 pos = 0;
+   while (pos < *size) {
+      u32 recordSize = 0;
+      if (*size - pos < sizeof(recordSize)) {
+         break;
+      }
+      memcpy(&recordSize, data + pos, sizeof(recordSize));
+
+      auto record = data + pos + sizeof(recordSize);
+      if (recordSize > *size - pos - sizeof(recordSize)) {
+         break;
+      }
+
+      // reader needs the document aligned, records are padded to keep it that way
+      PaletteRecord value;
+      auto view = scfViewChecked(record, recordSize);
+      if (scfReaderNull(view) || !scfRead(view, value)) {
+         break;
+      }
+
+      switch (value.op) {
+      case PaletteOp_PUT: _loadPalette(assets, value.name.c_str(), value.palette); break;
+      case PaletteOp_DELETE: _unloadPalette(assets, value.name.c_str()); break;
+      }
+
+      pos += _align4(sizeof(recordSize) + recordSize);
+   }
+
+   *torn = pos != *size;
+   delete[] data;
+   return true;
+}
+
+// copies the library on the caller's thread so the save can serialize it while it's edited, only done
+// when a journal outgrows the base so it costs about as much as the appends that led up to it
+static PaletteSnapshot _snapshotPalettes(Assets *assets) {
+   PaletteSnapshot out;
+   out.reserve(assets->palettes.size());
+   for (auto &p : assets->palettes) {
+      out.push_back({ p.first, *p.second });
+   }
+   return out;
+}
+
+// queues the base for generation and drops the journals it replaces once it's in, compacting is
+// cleared after. If it can't be written the old base and its journals are all still there and still load
+static void _savePaletteBase(Assets *assets, std::shared_ptr<PaletteSnapshot> palettes, u32 fromGeneration, u32 generation) {
+   auto path = _assetPath(assets, PalettePath);
+   saveQueuePush(saveQueueGlobal(), path.c_str(), 
+      [=](SCFWriter *writer) {
+         scfWriteDictBegin(writer);
+         for (auto &p : *palettes) {
+            scfWriteDictKey(writer, p.first.c_str());
+            scfWrite(writer, p.second);
+         }
+         scfWriteDictEnd(writer);
+         scfWrite(writer, generation);
+         return true;
+      }, 
+      [=](u64 size) {
+         if (size) {
+            assets->baseStamp = fileStamp(path.c_str());
+
+            // oldest first so a crash partway leaves a contiguous run for the next load to clear
+            for (u32 g = fromGeneration; g < generation; ++g) {
+               remove(_journalPath(assets, g).c_str());
+            }
+
+            assets->baseGeneration = generation;
+            assets->baseSize = size;
+         }
+         assets->compacting = false;
+      });
+}
+
+static void _closeJournal(Assets *assets) {
+   if (assets->journal) {
+      fclose(assets->journal);
+      assets->journal = nullptr;
+   }
+}
+
+static void _compactPalettes(Assets *assets) {
+   if (assets->compacting.exchange(true)) {
+      return;
+   }
+
+   // appends move on to the next journal right away, the job folds everything before it into the base
+   _closeJournal(assets);
+   auto fromGeneration = assets->baseGeneration;
+   auto generation = ++assets->journalGeneration;
+   assets->journalSize = 0;
+
+   _savePaletteBase(assets, std::make_shared<PaletteSnapshot>(_snapshotPalettes(assets)), fromGeneration, generation);
+}
+
+static void _loadPalettes(Assets *assets) {
+   // stamped first so a change made while it's read is seen as one
+   assets->baseStamp = fileStamp(_assetPath(assets, PalettePath).c_str());
+   _loadPaletteBase(assets);
+
+   // journals below the base were compacted into it but the job didn't get to clearing them
+   for (auto g = assets->baseGeneration; g-- > 0 && remove(_journalPath(assets, g).c_str()) == 0;) {}
+
+   auto generation = assets->journalGeneration = assets->baseGeneration;
+   u64 size = 0;
+   bool torn = false;
+   while (_replayJournal(assets, generation, &size, &torn) && !torn) {
+      assets->journalGeneration = generation++;
+      assets->journalSize = size;
+   }
+
+   if (torn) {
+      assets->journalGeneration = generation;
+      assets->journalSize = 0;
+      assets->journalTorn = true;
+   }
+
+   _indexBuild(assets);
+}
+
+// appending after a torn record would hide everything written after it, so it's folded into the base first.
+// Done on the Assets that keeps the library, the base save calls back into it when it's written
+static void _repairTornJournal(Assets *assets) {
+   if (assets->journalTorn) {
+      assets->journalTorn = false;
+      _compactPalettes(assets);
+   }
+}
+
+static void _appendPaletteRecord(Assets *assets, PaletteRecord const& record) {
+   // the change is already in the library, so the compaction that repairs the journal saves it
+   if (assets->journalTorn) {
+      if (!assets->compacting) {
+         _repairTornJournal(assets);
+      }
+      return;
+   }
+
+   auto writer = assets->writer;
+   scfWriterReset(writer);
+   scfWrite(writer, record);
+
+   u32 size = 0;
+   auto out = scfWriterFinish(writer, &size);
+   if (!out) {
+      return;
+   }
+
+   if (!assets->journal) {
+      assets->journal = fopen(_journalPath(assets, assets->journalGeneration).c_str(), "ab");
+      if (!assets->journal) {
+         return;
+      }
+   }
+
+   static const byte padding[4] = { 0 };
+   auto padded = _align4(sizeof(size) + size);
+   auto padBytes = padded - sizeof(size) - size;
+   auto written = fwrite(&size, sizeof(size), 1, assets->journal) == 1 &&
+      fwrite(out, 1, size, assets->journal) == size &&
+      fwrite(padding, 1, padBytes, assets->journal) == padBytes &&
+      !fflush(assets->journal);
+
+   // a short write leaves a partial record that would hide every append after it, so the
+   // library is folded into a new base instead and appends go on in the next journal
+   if (!written) {
+      _closeJournal(assets);
+      assets->journalTorn = true;
+      if (!assets->compacting) {
+         _repairTornJournal(assets);
+      }
+      return;
+   }
+
+   assets->journalSize += padded;
+   if (!assets->compacting && assets->journalSize > MAX(PaletteJournalLimit, assets->baseSize)) {
+      _compactPalettes(assets);
+   }
+}
+
+// moves a library loaded into a scratch Assets into the live one
+static void _takePalettes(Assets *assets, Assets *loaded) {
+   assets->palettes.swap(loaded->palettes);
+   assets->names.swap(loaded->names);
+   assets->grams.swap(loaded->grams);
+   assets->indexed = loaded->indexed;
+   assets->searchValid = false;
+
+   assets->journalGeneration = loaded->journalGeneration;
+   assets->journalSize = loaded->journalSize;
+   assets->baseGeneration = loaded->baseGeneration;
+   assets->baseSize = loaded->baseSize;
+   assets->baseStamp = loaded->baseStamp;
+   assets->journalTorn = loaded->journalTorn;
+   loaded->journalTorn = false; // loaded goes with the old library now
+}
+
+// the library is swapped in whole once it's loaded, until then the old one is still there
+static void _beginLoading(Assets *assets) {
+   auto assetsFolder = assets->assetsFolder;
+   assets->loading = loaderLoad<Assets*>(assets->loader, 
+      [=]() {
+         auto loaded = new Assets();
+         loaded->assetsFolder = assetsFolder;
+         loaded->writer = scfWriterCreate();
+         _loadPalettes(loaded);
+         return loaded;
+      }, 
+      [=](Assets *loaded) {
+         _takePalettes(assets, loaded);
+         assetsDestroy(loaded); // takes the old library with it
+         assets->loading = 0;
+         _repairTornJournal(assets);
+      });
+}
+
+// Something else replaced pal.bin, what it holds wins over anything journaled on top of ours.
+// Our journals only go once the new base has loaded, one that can't be read yet (still being
+// written, locked, damaged) leaves the library as it is until the file changes again
+static void _reloadPalettes(Assets *assets) {
+   auto assetsFolder = assets->assetsFolder;
+   assets->loading = loaderLoad<Assets*>(assets->loader,
+      [=]() {
+         auto loaded = new Assets();
+         loaded->assetsFolder = assetsFolder;
+         loaded->writer = scfWriterCreate();
+         loaded->baseStamp = fileStamp(_assetPath(loaded, PalettePath).c_str());
+         if (!_loadPaletteBase(loaded)) {
+            assetsDestroy(loaded);
+            return (Assets*)nullptr;
+         }
+
+         loaded->journalGeneration = loaded->baseGeneration;
+         _indexBuild(loaded);
+         return loaded;
+      },
+      [=](Assets *loaded) {
+         assets->loading = 0;
+         if (!loaded) {
+            return;
+         }
+
+         _closeJournal(assets);
+         for (auto g = assets->baseGeneration; g <= assets->journalGeneration; ++g) {
+            remove(_journalPath(assets, g).c_str());
+         }
+         _takePalettes(assets, loaded);
+         assetsDestroy(loaded); // takes the old library with it
+      });
+}
+
+// the old pack and everything taken out of it goes once the new one is in
+static void _reloadPack(Assets *assets) {
+   auto path = _assetPath(assets, PackPath);
+   assets->packLoading = loaderLoad<AssetPack*>(assets->loader,
+      [=]() { return assetPackOpen(path.c_str()); },
+      [=](AssetPack *pack) {
+         if (assets->pack) {
+            assetPackClose(assets->pack);
+         }
+         assets->pack = pack;
+         assets->packLoading = 0;
+      });
+}
+
+// changes have to journal on top of the whole library
+static void _finishLoading(Assets *assets) {
+   if (assets->loading) {
+      loaderFinish(assets->loader, assets->loading);
+   }
+}
+
+void assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal) {
+   _finishLoading(assets);
+   _loadPalette(assets, name, *pal);
+
+   PaletteRecord record;
+   record.op = PaletteOp_PUT;
+   record.name = name;
+   record.palette = *pal;
+   _appendPaletteRecord(assets, record);
+}
+void assetsPaletteDelete(Assets *assets, StringView name) {
+   _finishLoading(assets);
+   if (!assetsPaletteRetrieve(assets, name)) {
+      return;
+   }
+   _unloadPalette(assets, name);
+
+   PaletteRecord record;
+   record.op = PaletteOp_DELETE;
+   record.name = name;
+   _appendPaletteRecord(assets, record);
+}
+EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name) {
+   auto found = assets->palettes.find(name);
+   if (found != assets->palettes.end()) {
+      return found->second;
+   }
+   return nullptr;
+}
+
+AssetNames assetsPaletteList(Assets *assets) {
+   return { assets->names.data(), (u32)assets->names.size() };
+}
+AssetNames assetsPaletteListPrefix(Assets *assets, StringView prefix) {
+   auto &names = assets->names;
+   auto len = strlen(prefix);
+   auto begin = std::lower_bound(names.begin(), names.end(), prefix, _nameLess);
+   auto end = std::partition_point(begin, names.end(), [&](Symbol name) { return !strncmp(name, prefix, len); });
+   return { names.data() + (begin - names.begin()), (u32)(end - begin) };
+}
+AssetNames assetsPaletteSearch(Assets *assets, StringView search) {
+   if (!search || !*search) {
+      return assetsPaletteList(assets);
+   }
+
+   // up to 3 characters is exactly one posting list
+   auto len = strlen(search);
+   if (len <= 3) {
+      auto found = assets->grams.find(_gram(search, (u32)len));
+      if (found == assets->grams.end()) {
+         return { nullptr, 0 };
+      }
+      return { found->second.data(), (u32)found->second.size() };
+   }
+
+   auto &out = assets->searchResults;
+   if (!assets->searchValid || assets->lastSearch != search) {
+      out.clear();
+
+      // only names with every trigram in search can match, so check the rarest one's list
+      std::vector<Symbol> const *candidates = nullptr;
+      for (auto c = search; c[2]; ++c) {
+         auto found = assets->grams.find(_gram(c, 3));
+         if (found == assets->grams.end()) {
+            candidates = nullptr;
+            break;
+         }
+         if (!candidates || found->second.size() < candidates->size()) {
+            candidates = &found->second;
+         }
+      }
+
+      if (candidates) {
+         for (auto name : *candidates) {
+            if (strstr(name, search)) {
+               out.push_back(name);
+            }
+         }
+      }
+
+      assets->lastSearch = search;
+      assets->searchValid = true;
+   }
+
+   return { out.data(), (u32)out.size() };
+}
+
+AssetPack *assetsGetPack(Assets *assets) {
+   return assets->pack;
+}
+
+void assetsPollChanges(Assets *assets) {
+   if (!assets->watcher) {
+      return;
+   }
+
+   for (auto &name : fileWatcherPoll(assets->watcher)) {
+      if (name == PalettePath) {
+         assets->paletteChanged = true;
+      }
+      else if (name == PackPath) {
+         assets->packChanged = true;
+      }
+   }
+
+   if (assets->paletteChanged && !assets->loading && !assets->compacting) {
+      assets->paletteChanged = false;
+      if (fileStamp(_assetPath(assets, PalettePath).c_str()) != assets->baseStamp) {
+         _reloadPalettes(assets);
+      }
+   }
+
+   if (assets->packChanged && !assets->packLoading) {
+      assets->packChanged = false;
+      _reloadPack(assets);
+   }
+}
+
+Assets *assetsCreate(StringView assetsFolder, Loader *loader) {
+   auto out = new Assets();
+   out->assetsFolder = assetsFolder;
+   out->writer = scfWriterCreate();
+   out->pack = assetPackOpen(_assetPath(out, PackPath).c_str());
+
+   if (!loader) {
+      _loadPalettes(out);
+      _repairTornJournal(out);
+      return out;
+   }
+
+   out->loader = loader;
+   out->watcher = fileWatcherCreate(assetsFolder ? assetsFolder : ".");
+   _beginLoading(out);
+   return out;
+}
+void assetsDestroy(Assets *assets) {
+   _finishLoading(assets);
+   if (assets->packLoading) {
+      loaderFinish(assets->loader, assets->packLoading);
+   }
+   if (assets->watcher) {
+      fileWatcherDestroy(assets->watcher);
+   }
+
+   if (assets->compacting) {
+      saveQueueFlush(saveQueueGlobal());
+   }
+   // a write that failed while compacting is still waiting to be repaired
+   _repairTornJournal(assets);
+   if (assets->compacting) {
+      saveQueueFlush(saveQueueGlobal());
+   }
+   _closeJournal(assets);
+
+   for (auto &p : assets->palettes) {
+      delete p.second;
+   }
+
+   if (assets->pack) {
+      assetPackClose(assets->pack);
+   }
+
+   scfWriterDestroy(assets->writer);
+   delete assets;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ega.h"
+
+#include <vector>
+#include <string>
+
+// Assets owns everything loaded out of the asset folder
+// it has no window or GL dependencies so tools can use it headless
+typedef struct Assets Assets;
+
+// with a loader the palette library loads on it, reading as empty until it's in and making
+// stores and deletes wait for it. The folder is also watched for pal.bin and assets.pack
+// being replaced by something else, see assetsPollChanges
+typedef struct Loader Loader;
+Assets *assetsCreate(StringView assetsFolder, Loader *loader = nullptr);
+void assetsDestroy(Assets *assets);
+
+// starts reloading whatever changed on disk since the last poll, call once a frame before pumping
+// the loader. Only changed files are reloaded and each is swapped in whole by its completion,
+// palettes replacing anything saved on top of the old pal.bin
+void assetsPollChanges(Assets *assets);
+
+void        assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal);
+void        assetsPaletteDelete(Assets *assets, StringView name);
+EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name);
+
+// Palette names are kept in a sorted index, queries return views straight into it or into a
+// buffer reused between queries, so they never allocate once warmed up.
+// Views are valid until the next query, store, delete or reload
+typedef struct {
+   Symbol const *names;
+   u32 count;
+} AssetNames;
+
+AssetNames assetsPaletteList(Assets *assets);
+AssetNames assetsPaletteListPrefix(Assets *assets, StringView prefix);
+AssetNames assetsPaletteSearch(Assets *assets, StringView search); // names containing search, sorted
+
+// the read-only assets.pack out of the asset folder, null if there isn't one
+// a changed pack replaces this one between frames, so don't hold onto it or anything out of it
+typedef struct AssetPack AssetPack;
+AssetPack  *assetsGetPack(Assets *assets);
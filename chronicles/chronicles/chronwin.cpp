@@ -1,6 +1,12 @@
 #include "chronwin.h"
 #include <nowide/convert.hpp>
 #include <Windows.h>
+#include <Psapi.h>
+
+#include <unordered_map>
+#include <chrono>
+
+#pragma comment(lib, "psapi.lib")
 
 std::string openFile(OpenFileConfig const& config) {
 
@@ -69,6 +75,49 @@ std::string pathGetFilename(StringView path) {
    return pathStr.substr(begin, len);
 }
 
+bool pathIsDirectory(StringView path) {
+   auto attr = GetFileAttributes(path);
+   return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool pathCreateDirectory(StringView path) {
+   std::string partial = path;
+   for (u32 i = 1; i < partial.size(); ++i) {
+      auto c = partial[i];
+      if ((c == '/' || c == '\') && partial[i - 1] != ':') {
+         partial[i] = 0;
+         CreateDirectory(partial.c_str(), nullptr);
+         partial[i] = c;
+      }
+   }
+
+   CreateDirectory(path, nullptr);
+   return pathIsDirectory(path);
+}
+
+std::vector<std::string> pathListFiles(StringView pattern) {
+   std::vector<std::string> out;
+
+   std::string dir = pattern;
+   auto slash = dir.find_last_of("\\/");
+   dir = slash != std::string::npos ? dir.substr(0, slash + 1) : "";
+
+   WIN32_FIND_DATA fd;
+   auto find = FindFirstFile(pattern, &fd);
+   if (find == INVALID_HANDLE_VALUE) {
+      return out;
+   }
+
+   do {
+      if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+         out.push_back(dir + fd.cFileName);
+      }
+   } while (FindNextFile(find, &fd));
+
+   FindClose(find);
+   return out;
+}
+
 byte *readFullFile(StringView path, u64 *fsize) {
    byte *string;
    u64 fsizeBuffer = 0;
@@ -95,6 +144,66 @@ byte *readFullFile(StringView path, u64 *fsize) {
    return string;
 }
 
+struct MappedFile {
+   HANDLE file = INVALID_HANDLE_VALUE;
+   HANDLE mapping = nullptr;
+   byte const *data = nullptr;
+   u64 size = 0;
+};
+
+MappedFile *fileMapReadOnly(StringView path, FileAccess access) {
+   DWORD flags = FILE_ATTRIBUTE_NORMAL;
+   switch (access) {
+   case FileAccess_SEQUENTIAL: flags |= FILE_FLAG_SEQUENTIAL_SCAN; break;
+   case FileAccess_RANDOM: flags |= FILE_FLAG_RANDOM_ACCESS; break;
+   }
+
+   // sharing delete lets a new version be renamed over the file while it's mapped
+   auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, flags, nullptr);
+   if (file == INVALID_HANDLE_VALUE) {
+      return nullptr;
+   }
+
+   LARGE_INTEGER size = { 0 };
+   if (!GetFileSizeEx(file, &size) || !size.QuadPart) {
+      CloseHandle(file);
+      return nullptr;
+   }
+
+   auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (!mapping) {
+      CloseHandle(file);
+      return nullptr;
+   }
+
+   auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   if (!data) {
+      CloseHandle(mapping);
+      CloseHandle(file);
+      return nullptr;
+   }
+
+   auto out = new MappedFile();
+   out->file = file;
+   out->mapping = mapping;
+   out->data = (byte const*)data;
+   out->size = size.QuadPart;
+   return out;
+}
+void fileUnmap(MappedFile *file) {
+   UnmapViewOfFile(file->data);
+   CloseHandle(file->mapping);
+   CloseHandle(file->file);
+   delete file;
+}
+
+byte const *mappedFileData(MappedFile *file) {
+   return file->data;
+}
+u64 mappedFileSize(MappedFile *file) {
+   return file->size;
+}
+
 int writeBinaryFile(StringView path, byte* buffer, u64 size) {
    auto fOut = fopen(path, "wb");
    if (!fOut) {
@@ -104,4 +213,163 @@ int writeBinaryFile(StringView path, byte* buffer, u64 size) {
    fwrite(buffer, sizeof(byte), size, fOut);
    fclose(fOut);
    return 1;
-}
\ No newline at end of file
+}
+
+bool fileReplace(StringView from, StringView to) {
+   return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+static u64 _fileStamp(u64 modified, u64 size) {
+   return modified ^ (size * 0x9E3779B97F4A7C15ull);
+}
+
+// how long a file has to go unchanged before it's reported
+static const Microseconds FileWatchSettle = 100000;
+
+u64 fileStamp(StringView path) {
+   WIN32_FILE_ATTRIBUTE_DATA data;
+   if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+      return 0;
+   }
+
+   u64 modified = ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+   u64 size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+   return _fileStamp(modified, size);
+}
+
+struct FileWatcher {
+   std::string folder;
+   std::unordered_map<std::string, Microseconds> changed;
+   bool rescan = false;
+
+   HANDLE dir = INVALID_HANDLE_VALUE;
+   OVERLAPPED overlapped = {};
+   bool reading = false;
+   DWORD buffer[16 * 1024]; // ReadDirectoryChangesW wants it DWORD aligned
+};
+
+static bool _watchBegin(FileWatcher *self) {
+   auto event = self->overlapped.hEvent;
+   self->overlapped = {};
+   self->overlapped.hEvent = event;
+
+   return ReadDirectoryChangesW(self->dir, self->buffer, sizeof(self->buffer), FALSE,
+      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+      nullptr, &self->overlapped, nullptr) != 0;
+}
+
+FileWatcher *fileWatcherCreate(StringView folder) {
+   auto dir = CreateFileA(folder, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+   if (dir == INVALID_HANDLE_VALUE) {
+      return nullptr;
+   }
+
+   auto out = new FileWatcher();
+   out->folder = folder;
+   out->dir = dir;
+   out->overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+   out->reading = out->overlapped.hEvent && _watchBegin(out);
+   if (!out->reading) {
+      fileWatcherDestroy(out);
+      return nullptr;
+   }
+   return out;
+}
+void fileWatcherDestroy(FileWatcher *self) {
+   if (self->reading) {
+      // the read has to let go of the buffer before it's freed
+      DWORD bytes = 0;
+      CancelIo(self->dir);
+      GetOverlappedResult(self->dir, &self->overlapped, &bytes, TRUE);
+   }
+   if (self->overlapped.hEvent) {
+      CloseHandle(self->overlapped.hEvent);
+   }
+   CloseHandle(self->dir);
+   delete self;
+}
+
+static void _watchRead(FileWatcher *self, Microseconds now) {
+   DWORD bytes = 0;
+   while (self->reading && GetOverlappedResult(self->dir, &self->overlapped, &bytes, FALSE)) {
+      if (!bytes) {
+         // the buffer overflowed and what changed is lost
+         self->rescan = true;
+      }
+
+      for (auto info = (FILE_NOTIFY_INFORMATION*)self->buffer; bytes; info = (FILE_NOTIFY_INFORMATION*)((byte*)info + info->NextEntryOffset)) {
+         switch (info->Action) {
+         case FILE_ACTION_ADDED:
+         case FILE_ACTION_MODIFIED:
+         case FILE_ACTION_RENAMED_NEW_NAME:
+            self->changed[nowide::narrow(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)))] = now;
+            break;
+         }
+
+         if (!info->NextEntryOffset) {
+            break;
+         }
+      }
+
+      self->reading = _watchBegin(self);
+   }
+}
+
+std::vector<std::string> fileWatcherPoll(FileWatcher *self) {
+   using namespace std::chrono;
+   Microseconds now = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+   _watchRead(self, now);
+
+   if (self->rescan) {
+      self->rescan = false;
+      for (auto &path : pathListFiles(format("%s/*", self->folder.c_str()).c_str())) {
+         auto slash = path.find_last_of("\\/");
+         self->changed[slash != std::string::npos ? path.substr(slash + 1) : path] = now;
+      }
+   }
+
+   std::vector<std::string> out;
+   for (auto iter = self->changed.begin(); iter != self->changed.end();) {
+      if (now - iter->second >= FileWatchSettle) {
+         out.push_back(iter->first);
+         iter = self->changed.erase(iter);
+      }
+      else {
+         ++iter;
+      }
+   }
+   return out;
+}
+
+bool fileWrite(StringView path, void const *data, u64 size, bool sync) {
+   auto file = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (file == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   auto bytes = (byte const*)data;
+   bool ok = true;
+   while (ok && size) {
+      DWORD written = 0;
+      ok = WriteFile(file, bytes, (DWORD)MIN(size, 0x40000000ull), &written, nullptr) && written;
+      bytes += written;
+      size -= written;
+   }
+
+   if (ok && sync) {
+      ok = FlushFileBuffers(file) != 0;
+   }
+   CloseHandle(file);
+   return ok;
+}
+
+u64 processPeakMemory() {
+   PROCESS_MEMORY_COUNTERS counters = { 0 };
+   counters.cb = sizeof(counters);
+   if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+      return 0;
+   }
+   return counters.PeakWorkingSetSize;
+}
@@ -3,6 +3,7 @@
 //insert all windows shit here
 
 #include <string>
+#include <vector>
 #include "defs.h"
 
 struct OpenFileConfig {
@@ -19,5 +20,46 @@ std::string cwd();
 
 byte *readFullFile(StringView path, u64 *fsize);
 int writeBinaryFile(StringView path, byte* buffer, u64 size);
+// moves from over to in one step, anything opening to sees either the old file or the new one
+bool fileReplace(StringView from, StringView to);
 
-std::string pathGetFilename(StringView path);
\ No newline at end of file
+// writes a whole file, with sync it's flushed to disk before returning instead of left to the OS
+bool fileWrite(StringView path, void const *data, u64 size, bool sync);
+
+// changes whenever the file is rewritten or replaced, 0 if it doesn't exist
+u64 fileStamp(StringView path);
+
+// read-only file mappings, pages are only faulted in as they're touched
+enum FileAccess_ {
+   FileAccess_NORMAL = 0,
+   FileAccess_SEQUENTIAL,
+   FileAccess_RANDOM
+};
+typedef byte FileAccess;
+
+typedef struct MappedFile MappedFile;
+MappedFile *fileMapReadOnly(StringView path, FileAccess access = FileAccess_NORMAL); // null on failure or empty files
+void fileUnmap(MappedFile *file);
+byte const *mappedFileData(MappedFile *file);
+u64 mappedFileSize(MappedFile *file);
+
+std::string pathGetFilename(StringView path);
+bool pathIsDirectory(StringView path);
+// creates the folder and any missing parents, true if it exists afterwards
+bool pathCreateDirectory(StringView path);
+
+// full paths of every file matching a wildcard pattern like "art/*.png"
+std::vector<std::string> pathListFiles(StringView pattern);
+
+// FileWatchers collect changes to the files directly in one folder, polled so they're picked up
+// on whichever thread asks. A file is only reported once it's been left alone for a moment,
+// so something still writing it isn't reported halfway through
+typedef struct FileWatcher FileWatcher;
+FileWatcher *fileWatcherCreate(StringView folder); // null if the folder can't be watched
+void fileWatcherDestroy(FileWatcher *self);
+
+// names of files written or moved into the folder since the last poll, each once
+std::vector<std::string> fileWatcherPoll(FileWatcher *self);
+
+// peak resident memory of this process so far, in bytes
+u64 processPeakMemory();
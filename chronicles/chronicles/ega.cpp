@@ -1,10 +1,25 @@
 #include "ega.h"
 #include "app.h"
+#include "scf.h"
+#include "jobs.h"
+#include "chronwin.h"
+#include "save.h"
 
 #include <string.h>
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define EGA_SSE2
+#include <emmintrin.h>
+#endif
 
 byte getBit(byte dest, byte pos/*0-7*/) {
    return !!(dest & (1 << (pos & 7)));
@@ -33,8 +48,10 @@ static void _buildColorTable(ColorRGB *table) {
 }
 
 ColorRGB g_egaToRGBTable[64] = { 0 };
+static void _buildGCRGBTable();
 void egaStartup() {
    _buildColorTable(g_egaToRGBTable);
+   _buildGCRGBTable();
 }
 
 //EGAColor egaReduceRGB(ColorRGB c) {
@@ -130,19 +147,16 @@ struct ImageColor {
    ImageColor() :closestColor(0) {}
 };
 
-float GCRGB(byte component) {
-   static float GCRGBTable[256] = { 0.0f };
-   static int loaded = 0;
-
-   if (!loaded) {
-      int i;
-      for (i = 0; i < 256; ++i) {
-         GCRGBTable[i] = pow(i / 255.0f, 2.2f);
-      }
-      loaded = 1;
+// built in egaStartup so encoding threads never race on it
+static float g_GCRGBTable[256] = { 0.0f };
+static void _buildGCRGBTable() {
+   for (int i = 0; i < 256; ++i) {
+      g_GCRGBTable[i] = pow(i / 255.0f, 2.2f);
    }
+}
 
-   return GCRGBTable[component];
+float GCRGB(byte component) {
+   return g_GCRGBTable[component];
 }
 
 static f32 sRGB(byte b) {
@@ -294,26 +308,54 @@ byte closestEGA(int rgb) {
 
 #pragma endregion
 
-EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette) {
-   int colorCounts[64];
+static Microseconds _encodeNow() {
+   using namespace std::chrono;
+   return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
 
-   auto texSize = textureGetSize(source);
+// Encoding runs in stages so several images can share one palette
+// histogram: maps every pixel to its closest EGA color and counts how often each appears
+// reduce: picks the palette from the (possibly merged) counts and builds the 64 -> 16 look-up table
+// map: writes the look-up table's colors out to an EGATexture
+struct EncodeImage {
+   ColorRGBA const *pixels = nullptr;
+   Int2 size = { 0 };
+   u32 pixelCount = 0;
+
+   byte *pixelMap = nullptr; // closest EGA color per pixel
+   f32 colorCounts[EGA_COLORS] = { 0 };
+   u32 opaqueCount = 0;
+};
 
-   auto pixelCount = texSize.x * texSize.y;
-   byte* alpha = new byte[pixelCount];
-   byte* pixelMap = new byte[pixelCount];
-   std::vector<int> cArray(pixelCount);
+// false for sources that failed to load, they're skipped by every stage after
+static bool _encodeImageInit(EncodeImage &img, Texture *source) {
+   if (!source) {
+      return false;
+   }
 
-   memset(resultPalette->colors, 0, 16);
-   memset(colorCounts, 0, sizeof(int) * 64);
-   memset(alpha, 0, pixelCount);
-   memset(pixelMap, 0, pixelCount);
+   img.pixels = textureGetPixels(source);
+   if (!img.pixels) {
+      return false;
+   }
+
+   img.size = textureGetSize(source);
+   img.pixelCount = img.size.x * img.size.y;
+   return true;
+}
+static void _encodeImageFree(EncodeImage &img) {
+   delete[] img.pixelMap;
+   img.pixelMap = nullptr;
+}
+
+static void _encodeHistogram(EncodeImage &img) {
+   auto texColors = img.pixels;
+   std::vector<int> cArray(img.pixelCount);
 
-   auto texColors = textureGetPixels(source);
+   img.pixelMap = new byte[img.pixelCount];
+   memset(img.pixelMap, 0, img.pixelCount);
 
    //push every pixel into a vector
-   for (int i = 0; i < texSize.x * texSize.y; ++i) {
-      alpha[i] = texColors[i].a == 255;
+   for (u32 i = 0; i < img.pixelCount; ++i) {
       cArray[i] = *(int*)&texColors[i];
    }
 
@@ -328,20 +370,25 @@ EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targe
       colorMap[i] = rgbega(cArray[i], closestEGA(cArray[i]));
 
    //go throuygh the image and log how often each EGA color appears
-   for (int i = 0; i < pixelCount; ++i) {
+   for (u32 i = 0; i < img.pixelCount; ++i) {
       int c = *(int*)&texColors[i];
 
       if (texColors[i].a != 255) {
-         pixelMap[i] = 0;
+         img.pixelMap[i] = 0;
          continue;
       }
 
       byte ega = std::lower_bound(begin(colorMap), end(colorMap), c)->ega;
 
-      pixelMap[i] = ega;
-      colorCounts[ega]++;
+      img.pixelMap[i] = ega;
+      img.colorCounts[ega] += 1.0f;
+      ++img.opaqueCount;
    }
+}
 
+// returns false if the target palette has no usable entries
+static bool _encodeReduce(f32 const *colorCounts, EGAPalette const *targetPalette, EGAPalette *resultPalette, byte *colorLUT) {
+   memset(resultPalette->colors, 0, 16);
 
    auto p = targetPalette->colors;
 
@@ -360,7 +407,7 @@ EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targe
    }
 
    if (!totalCount) {
-      return nullptr;
+      return false;
    }
 
    std::list<PaletteColor> palette;
@@ -455,35 +502,541 @@ EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targe
       }
    }
 
-   byte colorLUT[64]; //look-up table from 64 colors down the 16 remaining colors.
+   //look-up table from 64 colors down the 16 remaining colors.
    LUTcolor = 0;
    for (auto& color : colors){
       colorLUT[LUTcolor++] = color.closestColor->color->EGAColor;
    }
 
    memcpy(resultPalette->colors, paletteOut, 16);
+   return true;
+}
+
+// Fixed palettes have every used slot locked to a distinct color so there's nothing for the reduction to pick.
+// The histogram is skipped entirely and pixels map straight through closest EGA color -> closest locked entry
+static bool _encodeIsFixed(EGAPalette const *targetPalette) {
+   bool seen[EGA_COLORS] = { false };
+   u32 used = 0;
+
+   for (auto c : targetPalette->colors) {
+      if (c == EGA_COLOR_UNUSED) {
+         continue;
+      }
+      if (c == EGA_COLOR_UNDEFINED || seen[c]) {
+         return false;
+      }
+      seen[c] = true;
+      ++used;
+   }
+
+   return used > 0;
+}
+
+// matches _encodeReduce's output for fixed palettes, including which entry wins a tie
+static void _encodeFixedReduce(EGAPalette const *targetPalette, EGAPalette *resultPalette, byte *colorLUT) {
+   memset(resultPalette->colors, EGA_COLOR_UNUSED, 16);
+
+   // used slots are packed to the front in order
+   byte locked[EGA_PALETTE_COLORS];
+   u32 count = 0;
+   for (auto c : targetPalette->colors) {
+      if (c != EGA_COLOR_UNUSED) {
+         resultPalette->colors[count] = c;
+         locked[count++] = c;
+      }
+   }
+
+   for (byte c = 0; c < EGA_COLORS; ++c) {
+      f32 best = FLT_MAX;
+      byte bestEGA = 0;
+
+      for (u32 i = 0; i < count; ++i) {
+         f32 d = sqrt(colorDistance(EGAColorLookup(c), EGAColorLookup(locked[i])));
+
+         // later insertions sort ahead of equal distances, so the highest color index wins
+         if (d < best || (d == best && locked[i] > bestEGA)) {
+            best = d;
+            bestEGA = locked[i];
+            colorLUT[c] = (byte)i;
+         }
+      }
+   }
+}
+
+// closestEGA is too slow to run per pixel, so each range keeps a direct-mapped cache of rgb -> ega
+static void _encodeFixedMap(EncodeImage const &img, byte const *colorLUT, EGATexture *out) {
+   const u32 CacheBits = 12;
+
+   jobPoolParallelFor(jobPoolGlobal(), img.pixelCount, 1 << 16, [&](u32 begin, u32 end) {
+      u32 keys[1 << CacheBits];
+      byte values[1 << CacheBits];
+      memset(keys, 0xFF, sizeof(keys));
+
+      for (u32 i = begin; i < end; ++i) {
+         auto &c = img.pixels[i];
+         if (c.a != 255) {
+            continue;
+         }
+
+         u32 rgb = c.r | (c.g << 8) | (c.b << 16);
+         u32 slot = (rgb * 2654435761u) >> (32 - CacheBits);
+
+         if (keys[slot] != rgb) {
+            keys[slot] = rgb;
+            values[slot] = closestEGA(*(int*)&c);
+         }
+
+         out->pixelData[i] = colorLUT[values[slot]];
+      }
+   });
+}
+
+#pragma region DITHERING
+
+// the final palette in the encoder's gamma space, laid out for 4-wide compares
+// unused slots sit far away so they never win
+struct DitherPalette {
+   alignas(16) f32 r[EGA_PALETTE_COLORS];
+   alignas(16) f32 g[EGA_PALETTE_COLORS];
+   alignas(16) f32 b[EGA_PALETTE_COLORS];
+};
+
+static void _ditherPaletteInit(DitherPalette &pal, EGAPalette const *palette) {
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      auto c = palette->colors[i];
+      if (c < EGA_COLORS) {
+         auto rgb = egaGetColor(c);
+         pal.r[i] = GCRGB(rgb.r);
+         pal.g[i] = GCRGB(rgb.g);
+         pal.b[i] = GCRGB(rgb.b);
+      }
+      else {
+         pal.r[i] = pal.g[i] = pal.b[i] = 1000.0f;
+      }
+   }
+}
+
+static EGAPColor _ditherNearest(DitherPalette const &pal, f32 r, f32 g, f32 b) {
+#ifdef EGA_SSE2
+   auto vr = _mm_set1_ps(r);
+   auto vg = _mm_set1_ps(g);
+   auto vb = _mm_set1_ps(b);
+
+   auto best = _mm_set1_ps(FLT_MAX);
+   auto bestIdx = _mm_setzero_si128();
+   auto idx = _mm_set_epi32(3, 2, 1, 0);
+   auto four = _mm_set1_epi32(4);
+
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; i += 4) {
+      auto dr = _mm_sub_ps(_mm_load_ps(pal.r + i), vr);
+      auto dg = _mm_sub_ps(_mm_load_ps(pal.g + i), vg);
+      auto db = _mm_sub_ps(_mm_load_ps(pal.b + i), vb);
+      auto d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+      auto closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+      best = _mm_min_ps(d, best);
+      bestIdx = _mm_or_si128(_mm_and_si128(closer, idx), _mm_andnot_si128(closer, bestIdx));
+      idx = _mm_add_epi32(idx, four);
+   }
+
+   alignas(16) f32 dists[4];
+   alignas(16) i32 idxs[4];
+   _mm_store_ps(dists, best);
+   _mm_store_si128((__m128i*)idxs, bestIdx);
+
+   u32 lane = 0;
+   for (u32 i = 1; i < 4; ++i) {
+      if (dists[i] < dists[lane] || (dists[i] == dists[lane] && idxs[i] < idxs[lane])) {
+         lane = i;
+      }
+   }
+   return (EGAPColor)idxs[lane];
+#else
+   f32 best = FLT_MAX;
+   EGAPColor out = 0;
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      auto dr = pal.r[i] - r, dg = pal.g[i] - g, db = pal.b[i] - b;
+      auto d = dr * dr + dg * dg + db * db;
+      if (d < best) {
+         best = d;
+         out = i;
+      }
+   }
+   return out;
+#endif
+}
+
+static const byte g_bayer8[8][8] = {
+   {  0, 32,  8, 40,  2, 34, 10, 42 },
+   { 48, 16, 56, 24, 50, 18, 58, 26 },
+   { 12, 44,  4, 36, 14, 46,  6, 38 },
+   { 60, 28, 52, 20, 62, 30, 54, 22 },
+   {  3, 35, 11, 43,  1, 33,  9, 41 },
+   { 51, 19, 59, 27, 49, 17, 57, 25 },
+   { 15, 47,  7, 39, 13, 45,  5, 37 },
+   { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+// nearest palette entry for every rgb quantized to 5 bits a channel, built once per encode so
+// the ordered dither is mostly a table lookup. Palette regions are convex so a cell whose corners
+// all share a nearest entry is inside it, cells a boundary runs through are marked and searched per pixel
+static const u32 DitherLUTBits = 5;
+static const u32 DitherLUTShift = 8 - DitherLUTBits;
+static const byte DitherLUTSearch = 0xFF;
+
+static void _ditherLUTBuild(std::vector<byte> &lut, DitherPalette const &pal) {
+   const u32 levels = 1 << DitherLUTBits;
+   const u32 corners = levels + 1;
+
+   // corner k sits at the bottom of cell k, the last one at 255
+   f32 cornerValues[corners];
+   for (u32 i = 0; i < corners; ++i) {
+      cornerValues[i] = GCRGB((byte)MIN(255u, i << DitherLUTShift));
+   }
+
+   std::vector<byte> nearest(corners * corners * corners);
+   jobPoolParallelFor(jobPoolGlobal(), corners, 1, [&](u32 begin, u32 end) {
+      for (u32 b = begin; b < end; ++b) {
+         for (u32 g = 0; g < corners; ++g) {
+            for (u32 r = 0; r < corners; ++r) {
+               nearest[(b * corners + g) * corners + r] = _ditherNearest(pal, cornerValues[r], cornerValues[g], cornerValues[b]);
+            }
+         }
+      }
+   });
+
+   lut.resize(levels * levels * levels);
+   jobPoolParallelFor(jobPoolGlobal(), levels, 1, [&](u32 begin, u32 end) {
+      for (u32 b = begin; b < end; ++b) {
+         for (u32 g = 0; g < levels; ++g) {
+            for (u32 r = 0; r < levels; ++r) {
+               auto first = nearest[(b * corners + g) * corners + r];
+               auto out = first;
+               for (u32 c = 1; c < 8 && out == first; ++c) {
+                  auto corner = nearest[((b + (c >> 2)) * corners + g + ((c >> 1) & 1)) * corners + r + (c & 1)];
+                  if (corner != first) {
+                     out = DitherLUTSearch;
+                  }
+               }
+               lut[(b << (DitherLUTBits * 2)) | (g << DitherLUTBits) | r] = out;
+            }
+         }
+      }
+   });
+}
+
+static byte _ditherLUTGet(std::vector<byte> const &lut, DitherPalette const &pal, byte r, byte g, byte b) {
+   auto out = lut[((b >> DitherLUTShift) << (DitherLUTBits * 2)) | ((g >> DitherLUTShift) << DitherLUTBits) | (r >> DitherLUTShift)];
+   if (out == DitherLUTSearch) {
+      out = _ditherNearest(pal, GCRGB(r), GCRGB(g), GCRGB(b));
+   }
+   return out;
+}
+
+// thresholds are applied in 0-255 space where one EGA channel step is 85.
+// Eight pixels of a row take the thresholds of their Bayer row at once as saturating byte adds,
+// negative thresholds split out into a saturating subtract
+static void _ditherOrdered(EncodeImage const &img, EGATexture *out, DitherPalette const &pal, f32 strength) {
+   std::vector<byte> lut;
+   _ditherLUTBuild(lut, pal);
+
+   i32 thresholds[8][8];
+   for (u32 y = 0; y < 8; ++y) {
+      for (u32 x = 0; x < 8; ++x) {
+         thresholds[y][x] = (i32)(((g_bayer8[y][x] + 0.5f) / 64.0f - 0.5f) * 85.0f * strength);
+      }
+   }
+
+#ifdef EGA_SSE2
+   // each threshold repeated over r, g, b and a of its pixel, alpha is never read
+   alignas(16) byte adds[8][32], subs[8][32];
+   for (u32 y = 0; y < 8; ++y) {
+      for (u32 x = 0; x < 8; ++x) {
+         auto t = MIN(255, MAX(-255, thresholds[y][x]));
+         memset(adds[y] + x * 4, MAX(0, t), 4);
+         memset(subs[y] + x * 4, MAX(0, -t), 4);
+      }
+   }
+#endif
+
+   auto w = (u32)img.size.x;
+   jobPoolParallelFor(jobPoolGlobal(), img.size.y, 16, [&](u32 begin, u32 end) {
+      for (u32 y = begin; y < end; ++y) {
+         auto row = thresholds[y & 7];
+         auto src = img.pixels + y * w;
+         auto dest = out->pixelData + y * w;
+
+         u32 x = 0;
+#ifdef EGA_SSE2
+         auto add0 = _mm_load_si128((__m128i const*)adds[y & 7]);
+         auto add1 = _mm_load_si128((__m128i const*)(adds[y & 7] + 16));
+         auto sub0 = _mm_load_si128((__m128i const*)subs[y & 7]);
+         auto sub1 = _mm_load_si128((__m128i const*)(subs[y & 7] + 16));
+
+         alignas(16) ColorRGBA dithered[8];
+         for (; x + 8 <= w; x += 8) {
+            auto p0 = _mm_loadu_si128((__m128i const*)(src + x));
+            auto p1 = _mm_loadu_si128((__m128i const*)(src + x + 4));
+            _mm_store_si128((__m128i*)dithered, _mm_subs_epu8(_mm_adds_epu8(p0, add0), sub0));
+            _mm_store_si128((__m128i*)(dithered + 4), _mm_subs_epu8(_mm_adds_epu8(p1, add1), sub1));
+
+            for (u32 i = 0; i < 8; ++i) {
+               if (src[x + i].a == 255) {
+                  auto &c = dithered[i];
+                  dest[x + i] = _ditherLUTGet(lut, pal, c.r, c.g, c.b);
+               }
+            }
+         }
+#endif
+         for (; x < w; ++x) {
+            auto &c = src[x];
+            if (c.a != 255) {
+               continue;
+            }
+
+            auto t = row[x & 7];
+            dest[x] = _ditherLUTGet(lut, pal,
+               (byte)MIN(255, MAX(0, c.r + t)),
+               (byte)MIN(255, MAX(0, c.g + t)),
+               (byte)MIN(255, MAX(0, c.b + t)));
+         }
+      }
+   });
+}
+
+struct DiffusionKernel {
+   f32 right, downLeft, down, downRight;
+};
+
+static void _ditherSpread(Float3 &dest, Float3 const &err, f32 weight) {
+   dest.x += err.x * weight;
+   dest.y += err.y * weight;
+   dest.z += err.z * weight;
+}
+
+// Rows run as a wavefront, each row is its own job and trails the row above it by two pixels
+// which is as far back as the kernel reaches. Every row gets an error buffer padded by one on each side.
+static void _ditherDiffuse(EncodeImage const &img, EGATexture *out, DitherPalette const &pal, DiffusionKernel k, f32 strength) {
+   const u32 ProgressBlock = 16;
+
+   auto w = (u32)img.size.x;
+   auto h = (u32)img.size.y;
+   auto stride = w + 2;
+
+   std::vector<Float3> errors((h + 1) * stride, Float3{ 0.0f, 0.0f, 0.0f });
+   std::vector<std::atomic<u32>> progress(h);
+   for (auto &p : progress) {
+      p.store(0, std::memory_order_relaxed);
+   }
+
+   k.right *= strength;
+   k.downLeft *= strength;
+   k.down *= strength;
+   k.downRight *= strength;
+
+   jobPoolParallelFor(jobPoolGlobal(), h, 1, [&](u32 begin, u32 end) {
+      for (u32 y = begin; y < end; ++y) {
+         auto src = img.pixels + y * w;
+         auto dest = out->pixelData + y * w;
+         auto errIn = errors.data() + y * stride + 1;
+         auto errOut = errors.data() + (y + 1) * stride + 1;
+         Float3 carry = { 0.0f, 0.0f, 0.0f };
+
+         for (u32 x = 0; x < w; ++x) {
+            if (y && x % ProgressBlock == 0) {
+               auto needed = MIN(w, x + ProgressBlock + 2);
+               while (progress[y - 1].load(std::memory_order_acquire) < needed) {
+                  std::this_thread::yield();
+               }
+            }
+
+            auto &c = src[x];
+            if (c.a != 255) {
+               carry = { 0.0f, 0.0f, 0.0f };
+            }
+            else {
+               Float3 want = {
+                  MIN(1.5f, MAX(-0.5f, GCRGB(c.r) + errIn[x].x + carry.x)),
+                  MIN(1.5f, MAX(-0.5f, GCRGB(c.g) + errIn[x].y + carry.y)),
+                  MIN(1.5f, MAX(-0.5f, GCRGB(c.b) + errIn[x].z + carry.z))
+               };
+
+               auto pc = _ditherNearest(pal, want.x, want.y, want.z);
+               dest[x] = pc;
+
+               Float3 err = { want.x - pal.r[pc], want.y - pal.g[pc], want.z - pal.b[pc] };
+               carry = { err.x * k.right, err.y * k.right, err.z * k.right };
+               auto below = errOut + x;
+               _ditherSpread(below[-1], err, k.downLeft);
+               _ditherSpread(below[0], err, k.down);
+               _ditherSpread(below[1], err, k.downRight);
+            }
 
-   auto out = egaTextureCreate(texSize.x, texSize.y);
+            if ((x + 1) % ProgressBlock == 0) {
+               progress[y].store(x + 1, std::memory_order_release);
+            }
+         }
+
+         progress[y].store(w, std::memory_order_release);
+      }
+   });
+}
+
+#pragma endregion
+
+static EGATexture *_encodeMap(EncodeImage const &img, byte const *colorLUT, EGAPalette const *palette, EGAEncodeOptions const &options) {
+   auto out = egaTextureCreate(img.size.x, img.size.y);
    egaClearAlpha(out);
-   for (int i = 0; i < pixelCount; ++i) {
-      
 
-      if (texColors[i].a == 255) {
-         EGAColor c = colorLUT[pixelMap[i]];
+   if (options.dither != EGADither_NONE) {
+      DitherPalette pal;
+      _ditherPaletteInit(pal, palette);
+
+      switch (options.dither) {
+      case EGADither_BAYER: 
+         _ditherOrdered(img, out, pal, options.ditherStrength); 
+         return out;
+      case EGADither_FLOYD_STEINBERG: 
+         _ditherDiffuse(img, out, pal, { 7 / 16.0f, 3 / 16.0f, 5 / 16.0f, 1 / 16.0f }, options.ditherStrength);
+         return out;
+      case EGADither_SIERRA_LITE:
+         _ditherDiffuse(img, out, pal, { 2 / 4.0f, 1 / 4.0f, 1 / 4.0f, 0.0f }, options.ditherStrength);
+         return out;
+      }
+   }
 
-         auto x = i % texSize.x;
-         auto y = i / texSize.x;
+   if (!img.pixelMap) {
+      _encodeFixedMap(img, colorLUT, out);
+      return out;
+   }
 
-         egaRenderPoint(out, { x, y }, c);
+   for (u32 i = 0; i < img.pixelCount; ++i) {
+      if (img.pixels[i].a == 255) {
+         out->pixelData[i] = colorLUT[img.pixelMap[i]];
       }
    }
 
-   delete[] alpha;
-   delete[] pixelMap;
+   return out;
+}
+
+EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette, EGAEncodeOptions const *options) {
+   EGAEncodeOptions defaultOptions;
+   if (!options) { options = &defaultOptions; }
+
+   EncodeImage img;
+   if (!_encodeImageInit(img, source)) {
+      return nullptr;
+   }
+
+   EGATexture *out = nullptr;
+   byte colorLUT[EGA_COLORS];
+   bool success = true;
+   EGAEncodeStats stats = { 0 };
 
+   auto t0 = _encodeNow();
+   if (_encodeIsFixed(targetPalette)) {
+      _encodeFixedReduce(targetPalette, resultPalette, colorLUT);
+      stats.reduce = _encodeNow() - t0;
+   }
+   else {
+      _encodeHistogram(img);
+
+      auto t1 = _encodeNow();
+      success = _encodeReduce(img.colorCounts, targetPalette, resultPalette, colorLUT);
+
+      stats.histogram = t1 - t0;
+      stats.reduce = _encodeNow() - t1;
+   }
+
+   auto t2 = _encodeNow();
+   if (success) {
+      out = _encodeMap(img, colorLUT, resultPalette, *options);
+   }
+
+   if (options->stats) {
+      stats.map = _encodeNow() - t2;
+      *options->stats = stats;
+   }
+
+   _encodeImageFree(img);
    return out;
 }
 
+bool egaTextureCreateFromTexturesEncode(Texture **sources, f32 const *weights, u32 count, EGAPalette *targetPalette, EGAPalette *resultPalette, EGATexture **outTextures, EGAEncodeOptions const *options) {
+   EGAEncodeOptions defaultOptions;
+   if (!options) { options = &defaultOptions; }
+
+   std::vector<EncodeImage> imgs(count);
+   memset(outTextures, 0, sizeof(EGATexture*) * count);
+
+   // path textures load lazily and may need the gl thread, so pull pixels here before going wide
+   for (u32 i = 0; i < count; ++i) {
+      _encodeImageInit(imgs[i], sources[i]);
+   }
+
+   byte colorLUT[EGA_COLORS];
+   bool success = true;
+   EGAEncodeStats stats = { 0 };
+
+   auto t0 = _encodeNow();
+   if (_encodeIsFixed(targetPalette)) {
+      _encodeFixedReduce(targetPalette, resultPalette, colorLUT);
+      stats.reduce = _encodeNow() - t0;
+   }
+   else {
+      jobPoolParallelFor(jobPoolGlobal(), count, 1, [&](u32 begin, u32 end) {
+         for (u32 i = begin; i < end; ++i) {
+            if (imgs[i].pixels) {
+               _encodeHistogram(imgs[i]);
+            }
+         }
+      });
+
+      // user weights give each image that share of the total, regardless of its size
+      f32 merged[EGA_COLORS] = { 0 };
+      for (u32 i = 0; i < count; ++i) {
+         auto &img = imgs[i];
+         if (!img.pixels) {
+            continue;
+         }
+
+         f32 scale = weights ? weights[i] / MAX(1u, img.opaqueCount) : 1.0f;
+
+         for (u32 c = 0; c < EGA_COLORS; ++c) {
+            merged[c] += img.colorCounts[c] * scale;
+         }
+      }
+
+      auto t1 = _encodeNow();
+      success = _encodeReduce(merged, targetPalette, resultPalette, colorLUT);
+
+      stats.histogram = t1 - t0;
+      stats.reduce = _encodeNow() - t1;
+   }
+
+   auto t2 = _encodeNow();
+   if (success) {
+      jobPoolParallelFor(jobPoolGlobal(), count, 1, [&](u32 begin, u32 end) {
+         for (u32 i = begin; i < end; ++i) {
+            if (imgs[i].pixels) {
+               outTextures[i] = _encodeMap(imgs[i], colorLUT, resultPalette, *options);
+            }
+         }
+      });
+   }
+
+   if (options->stats) {
+      stats.map = _encodeNow() - t2;
+      *options->stats = stats;
+   }
+
+   for (auto &img : imgs) {
+      _encodeImageFree(img);
+   }
+
+   return success;
+}
+
 // target must exist and must match ega's size, returns !0 on success
 int egaTextureDecode(EGATexture *self, Texture* target, EGAPalette *palette){
 
@@ -520,13 +1073,351 @@ int egaTextureDecode(EGATexture *self, Texture* target, EGAPalette *palette){
    return 1;
 }
 
+void egaTextureWriteSCF(EGATexture *self, SCFWriter *writer) {
+   scfWriteListBegin(writer);
+   scfWriteInt(writer, (i32)self->w);
+   scfWriteInt(writer, (i32)self->h);
+   scfWriteCompressed(writer, self->pixelData, self->pixelCount);
+   scfWriteListEnd(writer);
+}
+// larger than any texture the game makes, keeps hostile sizes from reaching egaTextureCreate
+static const i32 EGATextureMaxSize = 16384;
+
+EGATexture *egaTextureReadSCF(SCFReader &view) {
+   auto list = scfReadList(view);
+   if (scfReaderNull(list)) {
+      return nullptr;
+   }
+
+   auto w = scfReadInt(list);
+   auto h = scfReadInt(list);
+   if (!w || !h || *w <= 0 || *h <= 0 || *w > EGATextureMaxSize || *h > EGATextureMaxSize) {
+      return nullptr;
+   }
+   auto pixelCount = (u64)*w * (u64)*h;
+
+   // older files have the pixels uncompressed
+   if (scfReaderPeek(list) == SCFType_COMPRESSED) {
+      if (scfReadCompressedSize(list) != pixelCount) {
+         return nullptr;
+      }
+
+      auto out = egaTextureCreate(*w, *h);
+      if (!scfReadCompressed(list, out->pixelData, out->pixelCount)) {
+         egaTextureDestroy(out);
+         return nullptr;
+      }
+      return out;
+   }
+
+   u32 byteCount = 0;
+   auto pixels = scfReadBytes(list, &byteCount);
+   if (!pixels || byteCount != pixelCount) {
+      return nullptr;
+   }
+
+   auto out = egaTextureCreate(*w, *h);
+   memcpy(out->pixelData, pixels, out->pixelCount);
+   return out;
+}
+
 int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size) {
-   return 0;
+   auto writer = scfWriterCreate();
+   egaTextureWriteSCF(self, writer);
+
+   u32 bSize = 0;
+   *outBuff = (byte*)scfWriteToBuffer(writer, &bSize);
+   *size = bSize;
+
+   scfWriterDestroy(writer);
+   return *outBuff != nullptr;
 }
 EGATexture *egaTextureDeserialize(byte *buff, u64 size) {
-   return nullptr;
+   auto view = scfView(buff);
+   if (scfReaderNull(view)) {
+      return nullptr;
+   }
+   return egaTextureReadSCF(view);
+}
+
+#pragma region ENCODE CACHE
+
+static u64 _hashMix(u64 h, u64 v) {
+   h ^= v;
+   h *= 0x9E3779B97F4A7C15ull;
+   return h ^ (h >> 29);
+}
+
+static u64 _hashBytes(void const *data, u64 size, u64 seed) {
+   auto b = (byte const*)data;
+   u64 h = _hashMix(seed, size);
+
+   for (; size >= sizeof(u64); size -= sizeof(u64), b += sizeof(u64)) {
+      u64 v;
+      memcpy(&v, b, sizeof(u64));
+      h = _hashMix(h, v);
+   }
+
+   u64 tail = 0;
+   memcpy(&tail, b, size);
+   return _hashMix(h, tail);
 }
 
+// written to disk as-is, memset before filling so padding compares equal
+struct EncodeCacheKey {
+   u64 pixelHash;
+   i32 w, h;
+   f32 ditherStrength;
+   EGAPalette target;
+   EGADither dither;
+   byte pad[3];
+};
+
+struct EncodeCacheEntry {
+   EncodeCacheKey key;
+   EGAPalette result;
+   EGATexture *ega = nullptr; // null when the encode failed
+   std::list<u64>::iterator used;
+};
+
+// entries past this are dropped least recently used first
+static const u64 EncodeCacheMaxBytes = 64 * 1024 * 1024;
+
+struct EGAEncodeCache {
+   std::string storePath;
+   std::mutex lock;
+   std::unordered_map<u64, EncodeCacheEntry> entries;
+   std::list<u64> used; // entry ids, most recently used first
+   u64 bytes = 0;
+
+   u32 hits = 0, misses = 0;
+   bool dirty = false;
+   u32 saving = 0; // saves queued that haven't finished, destroy waits on them
+};
+
+static u64 _encodeCacheId(EncodeCacheKey const &key) {
+   return _hashBytes(&key, sizeof(EncodeCacheKey), 0);
+}
+
+static u64 _encodeCacheEntryBytes(EncodeCacheEntry const &entry) {
+   return sizeof(EncodeCacheEntry) + (entry.ega ? entry.ega->pixelCount : 0);
+}
+
+static void _encodeCacheRemove(EGAEncodeCache *self, std::unordered_map<u64, EncodeCacheEntry>::iterator it) {
+   auto &e = it->second;
+   self->bytes -= _encodeCacheEntryBytes(e);
+   self->used.erase(e.used);
+   if (e.ega) {
+      egaTextureDestroy(e.ega);
+   }
+   self->entries.erase(it);
+}
+
+// takes ownership of entry.ega
+static void _encodeCacheInsert(EGAEncodeCache *self, EncodeCacheEntry const &entry) {
+   auto id = _encodeCacheId(entry.key);
+   auto found = self->entries.find(id);
+   if (found != self->entries.end()) {
+      _encodeCacheRemove(self, found);
+   }
+
+   auto &slot = self->entries[id];
+   slot = entry;
+   self->used.push_front(id);
+   slot.used = self->used.begin();
+   self->bytes += _encodeCacheEntryBytes(slot);
+
+   while (self->bytes > EncodeCacheMaxBytes && self->used.size() > 1) {
+      _encodeCacheRemove(self, self->entries.find(self->used.back()));
+   }
+}
+
+// store is a list of [key bytes, result palette bytes, texture] sublists, least recently used first.
+// Failed encodes aren't stored
+static void _encodeCacheLoad(EGAEncodeCache *self) {
+   auto file = scfOpenFile(self->storePath.c_str(), SCFAccess_SEQUENTIAL);
+   if (!file) {
+      return;
+   }
+
+   auto view = scfFileViewChecked(file);
+   while (!scfReaderAtEnd(view)) {
+      auto list = scfReadList(view);
+      if (scfReaderNull(list)) {
+         break;
+      }
+
+      u32 keySize = 0, palSize = 0;
+      auto key = scfReadBytes(list, &keySize);
+      auto pal = scfReadBytes(list, &palSize);
+      if (!key || keySize != sizeof(EncodeCacheKey) || !pal || palSize != sizeof(EGAPalette)) {
+         break;
+      }
+
+      EncodeCacheEntry entry;
+      memcpy(&entry.key, key, sizeof(EncodeCacheKey));
+      memcpy(&entry.result, pal, sizeof(EGAPalette));
+      entry.ega = egaTextureReadSCF(list);
+      if (!entry.ega) {
+         break;
+      }
+
+      _encodeCacheInsert(self, entry);
+   }
+
+   scfCloseFile(file);
+}
+
+EGAEncodeCache *egaEncodeCacheCreate(StringView storePath) {
+   auto out = new EGAEncodeCache();
+   if (storePath) {
+      out->storePath = storePath;
+      _encodeCacheLoad(out);
+   }
+   return out;
+}
+void egaEncodeCacheDestroy(EGAEncodeCache *self) {
+   // queued saves still point at the cache
+   u32 saving = 0;
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      saving = self->saving;
+   }
+   if (saving) {
+      saveQueueFlush(saveQueueGlobal());
+   }
+
+   for (auto &e : self->entries) {
+      if (e.second.ega) {
+         egaTextureDestroy(e.second.ega);
+      }
+   }
+   delete self;
+}
+
+EGATexture *egaEncodeCacheEncode(EGAEncodeCache *self, Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette, EGAEncodeOptions const *options) {
+   EGAEncodeOptions defaultOptions;
+   if (!options) { options = &defaultOptions; }
+
+   auto pixels = textureGetPixels(source);
+   if (!pixels) {
+      return nullptr;
+   }
+
+   auto size = textureGetSize(source);
+
+   EncodeCacheKey key;
+   memset(&key, 0, sizeof(EncodeCacheKey));
+   key.w = size.x;
+   key.h = size.y;
+   key.pixelHash = _hashBytes(pixels, (u64)size.x * size.y * sizeof(ColorRGBA), ((u64)size.x << 32) | (u32)size.y);
+   key.target = *targetPalette;
+   key.dither = options->dither;
+   key.ditherStrength = options->dither != EGADither_NONE ? options->ditherStrength : 0.0f;
+
+   auto id = _encodeCacheId(key);
+
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      auto found = self->entries.find(id);
+      if (found != self->entries.end() && !memcmp(&found->second.key, &key, sizeof(EncodeCacheKey))) {
+         ++self->hits;
+         self->used.splice(self->used.begin(), self->used, found->second.used);
+         *resultPalette = found->second.result;
+         if (options->stats) {
+            *options->stats = { 0 };
+         }
+         return found->second.ega ? egaTextureCreateCopy(found->second.ega) : nullptr;
+      }
+      ++self->misses;
+   }
+
+   EncodeCacheEntry entry;
+   entry.key = key;
+   entry.result = *resultPalette;
+
+   auto out = egaTextureCreateFromTextureEncode(source, targetPalette, &entry.result, options);
+   *resultPalette = entry.result;
+   entry.ega = out ? egaTextureCreateCopy(out) : nullptr;
+
+   std::lock_guard<std::mutex> lk(self->lock);
+   _encodeCacheInsert(self, entry);
+   self->dirty = true;
+
+   return out;
+}
+
+EGAEncodeCacheStats egaEncodeCacheGetStats(EGAEncodeCache *self) {
+   std::lock_guard<std::mutex> lk(self->lock);
+   return { self->hits, self->misses, (u32)self->entries.size() };
+}
+
+// runs on the save queue. The entries are copied under the lock and written outside it so encodes
+// aren't held up by the write, dirty is cleared as they're taken so anything added meanwhile marks it again
+static bool _encodeCacheWrite(EGAEncodeCache *self, SCFWriter *writer) {
+   std::vector<EncodeCacheEntry> copies;
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      copies.reserve(self->entries.size());
+      for (auto it = self->used.rbegin(); it != self->used.rend(); ++it) {
+         auto &e = self->entries.find(*it)->second;
+         if (e.ega) {
+            copies.push_back(e);
+            copies.back().ega = egaTextureCreateCopy(e.ega);
+         }
+      }
+      self->dirty = false;
+   }
+
+   for (auto &e : copies) {
+      scfWriteListBegin(writer);
+      scfWriteBytes(writer, &e.key, sizeof(EncodeCacheKey));
+      scfWriteBytes(writer, &e.result, sizeof(EGAPalette));
+      egaTextureWriteSCF(e.ega, writer);
+      scfWriteListEnd(writer);
+      egaTextureDestroy(e.ega);
+   }
+   return true;
+}
+
+// false if there was nothing to save
+static bool _encodeCacheQueueSave(EGAEncodeCache *self) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      if (self->storePath.empty() || !self->dirty) {
+         return false;
+      }
+      ++self->saving;
+   }
+
+   saveQueuePush(saveQueueGlobal(), self->storePath.c_str(), 
+      [=](SCFWriter *writer) { return _encodeCacheWrite(self, writer); },
+      [=](u64 size) {
+         std::lock_guard<std::mutex> lk(self->lock);
+         if (!size) {
+            self->dirty = true;
+         }
+         --self->saving;
+      });
+   return true;
+}
+
+bool egaEncodeCacheSave(EGAEncodeCache *self) {
+   if (!_encodeCacheQueueSave(self)) {
+      return true;
+   }
+
+   saveQueueFlush(saveQueueGlobal());
+
+   std::lock_guard<std::mutex> lk(self->lock);
+   return !self->dirty;
+}
+void egaEncodeCacheSaveLater(EGAEncodeCache *self) {
+   _encodeCacheQueueSave(self);
+}
+
+#pragma endregion
+
 void egaTextureResize(EGATexture *self, u32 width, u32 height) {
    if (width == self->w && height == self->h) {
       return;
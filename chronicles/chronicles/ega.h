@@ -48,17 +48,72 @@ EGATexture *egaTextureCreate(u32 width, u32 height);
 EGATexture *egaTextureCreateCopy(EGATexture const *other);
 void egaTextureDestroy(EGATexture *self);
 
-// encoding and decoding from an rgb texture
+// dithering is applied when mapping pixels to the final 16-color palette
+enum EGADither_ {
+   EGADither_NONE = 0,
+   EGADither_BAYER,           // 8x8 ordered threshold matrix
+   EGADither_FLOYD_STEINBERG, // error diffusion
+   EGADither_SIERRA_LITE,     // error diffusion, cheaper and a little softer
+   EGADither_COUNT
+};
+typedef byte EGADither;
+
+// wall time spent in each encoder stage, histogram is 0 for fully locked palettes
+typedef struct {
+   Microseconds histogram, reduce, map;
+} EGAEncodeStats;
+
+typedef struct {
+   EGADither dither = EGADither_NONE;
+   f32 ditherStrength = 1.0f; // scales the threshold spread or the diffused error
+   EGAEncodeStats *stats = nullptr; // optional, filled in by the encode
+} EGAEncodeOptions;
+
+// encoding and decoding from an rgb texture, null options is the default EGAEncodeOptions
 typedef struct Texture Texture;
-EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette);
+EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette, EGAEncodeOptions const *options = nullptr);
+
+// encodes several textures against one shared palette by merging their color histograms before reducing
+// weights (optional) give each image that share of the merged histogram, otherwise images count by pixels
+// outTextures receives count textures (null for sources that failed to load), returns false if the palette couldn't be built
+bool egaTextureCreateFromTexturesEncode(Texture **sources, f32 const *weights, u32 count, EGAPalette *targetPalette, EGAPalette *resultPalette, EGATexture **outTextures, EGAEncodeOptions const *options = nullptr);
 
 // target must exist and must match ega's size, returns !0 on success
 int egaTextureDecode(EGATexture *self, Texture* target, EGAPalette *palette);
 
-// binary serialization
+// binary serialization, outBuff is allocated with new[] and owned by the caller
 int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size);
 EGATexture *egaTextureDeserialize(byte *buff, u64 size);
 
+// writes/reads the texture as a single SCF sublist for embedding in larger documents
+typedef struct SCFWriter SCFWriter;
+struct SCFReader;
+void egaTextureWriteSCF(EGATexture *self, SCFWriter *writer);
+EGATexture *egaTextureReadSCF(SCFReader &view);
+
+// EGAEncodeCaches remember encode results keyed by a hash of the source pixels, the target palette and options
+// storePath is optional, entries are loaded from it on create and written back with egaEncodeCacheSave.
+// Entries past 64MB are dropped least recently used first
+// the cache is threadsafe
+typedef struct EGAEncodeCache EGAEncodeCache;
+EGAEncodeCache *egaEncodeCacheCreate(StringView storePath = nullptr);
+void egaEncodeCacheDestroy(EGAEncodeCache *self);
+
+// same contract as egaTextureCreateFromTextureEncode, the returned texture is a copy owned by the caller
+EGATexture *egaEncodeCacheEncode(EGAEncodeCache *self, Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette, EGAEncodeOptions const *options = nullptr);
+
+typedef struct {
+   u32 hits, misses;
+   u32 entries;
+} EGAEncodeCacheStats;
+EGAEncodeCacheStats egaEncodeCacheGetStats(EGAEncodeCache *self);
+
+// writes every entry to storePath on the global save queue if anything changed since loading or the
+// last save, blocking until it's written. Returns false on a failed write
+bool egaEncodeCacheSave(EGAEncodeCache *self);
+// the same without waiting, saves queued in a burst are written once
+void egaEncodeCacheSaveLater(EGAEncodeCache *self);
+
 Int2 egaTextureGetSize(EGATexture const *self);
 
 void egaTextureResize(EGATexture *self, u32 width, u32 height);
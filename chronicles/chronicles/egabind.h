@@ -0,0 +1,8 @@
+#pragma once
+
+#include "ega.h"
+#include "scfbind.h"
+
+// SCF bindings for the EGA types, shared by everything that stores them so each binding
+// is declared once
+SCF_BIND_BYTES(EGAPalette);
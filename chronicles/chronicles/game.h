@@ -2,14 +2,14 @@
 
 #include "math.h"
 #include "ega.h"
+#include "assets.h"
 
 #include <vector>
 #include <string>
 
 typedef struct Texture Texture;
 typedef struct EGATexture EGATexture;
-
-typedef struct Assets Assets;
+typedef struct Loader Loader;
 
 struct GameData {
    struct {
@@ -24,7 +24,9 @@ struct GameData {
 
    } primaryView;
 
-   Assets *assets = nullptr;
+   Loader *loader = nullptr;              // pumped once a frame by appStep
+   Assets *assets = nullptr;              // palettes load on the loader and read as empty until they're in
+   EGAEncodeCache *encodeCache = nullptr; // persisted next to the assets, null until it's loaded
 };
 
 GameData* gameGet();
@@ -39,10 +41,6 @@ void gameUpdate(Game* game, Window* wnd);
 void gameDestroy(Game* game);
 void gameDoUI(Window* wnd);
 
-void        assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal);
-void        assetsPaletteDelete(Assets *assets, StringView name);
-EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name);
-std::vector<std::string> assetsPaletteGetList(Assets *assets, StringView search = nullptr);
 
 
 
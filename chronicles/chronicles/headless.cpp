@@ -0,0 +1,73 @@
+// CPU-only implementation of the Texture api from app.h for command line tools
+// pixels are decoded eagerly and there are no GL handles, link this instead of app.cpp
+
+#include "app.h"
+#include <stb/stb_image.h>
+
+#include <string.h>
+
+struct Texture {
+   TextureConfig config = { 0 };
+   ColorRGBA *pixels = nullptr;
+   Int2 size = { 0 };
+};
+
+static Texture *_textureCreateFromSTB(byte* data, int x, int y, TextureConfig const& config) {
+   if (!data) {
+      return nullptr;
+   }
+
+   auto out = textureCreateCustom(x, y, config);
+   memcpy(out->pixels, data, x * y * sizeof(ColorRGBA));
+   stbi_image_free(data);
+   return out;
+}
+
+Texture *textureCreateFromPath(StringView path, TextureConfig const& config) {
+   int x = 0, y = 0, comps = 0;
+   auto data = stbi_load(path, &x, &y, &comps, 4);
+   return _textureCreateFromSTB(data, x, y, config);
+}
+Texture *textureLoadFromPath(StringView path, TextureConfig const& config) {
+   return textureCreateFromPath(path, config);
+}
+Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag) {
+   int x = 0, y = 0, comps = 0;
+   auto data = stbi_load_from_memory(buffer, (int32_t)size, &x, &y, &comps, 4);
+
+   if (flag == TextureFromBufferFlag_TAKE_OWNERHSIP) {
+      delete[] buffer;
+   }
+
+   return _textureCreateFromSTB(data, x, y, config);
+}
+Texture *textureCreateCustom(u32 width, u32 height, TextureConfig const& config) {
+   Texture* out = new Texture();
+
+   out->config = config;
+   out->size.x = width;
+   out->size.y = height;
+   out->pixels = new ColorRGBA[width*height];
+   memset(out->pixels, 0, width * height * sizeof(ColorRGBA));
+
+   return out;
+}
+void textureDestroy(Texture *self) {
+   delete[] self->pixels;
+   delete self;
+}
+
+void textureSetPixels(Texture *self, byte *data) {
+   memcpy(self->pixels, data, self->size.x * self->size.y * sizeof(ColorRGBA));
+}
+Int2 textureGetSize(Texture *t) {
+   return t->size;
+}
+
+uPtr textureGetHandle(Texture *) {
+   return 0;
+}
+
+const ColorRGBA *textureGetPixels(Texture *self) {
+   return self->pixels;
+}
@@ -0,0 +1,163 @@
+#include "jobs.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+struct JobPool {
+   std::vector<std::thread> threads;
+
+   std::mutex lock;
+   std::condition_variable jobReady;
+   std::condition_variable jobDone;
+   std::deque<std::function<void()>> queue;
+
+   u32 pending = 0; // queued + running, guarded by lock
+   bool stopping = false;
+};
+
+static void _runJob(JobPool *self, std::function<void()> &job) {
+   job();
+
+   std::unique_lock<std::mutex> lk(self->lock);
+   --self->pending;
+   lk.unlock();
+   self->jobDone.notify_all();
+}
+
+// pops and runs one job if there is one, returns false if the queue was empty
+static bool _helpOne(JobPool *self) {
+   std::unique_lock<std::mutex> lk(self->lock);
+   if (self->queue.empty()) {
+      return false;
+   }
+
+   auto job = std::move(self->queue.front());
+   self->queue.pop_front();
+   lk.unlock();
+
+   _runJob(self, job);
+   return true;
+}
+
+static void _workerMain(JobPool *self) {
+   while (true) {
+      std::unique_lock<std::mutex> lk(self->lock);
+      self->jobReady.wait(lk, [=] { return self->stopping || !self->queue.empty(); });
+
+      if (self->queue.empty()) {
+         return; // stopping and drained
+      }
+
+      auto job = std::move(self->queue.front());
+      self->queue.pop_front();
+      lk.unlock();
+
+      _runJob(self, job);
+   }
+}
+
+JobPool *jobPoolCreate(u32 threadCount) {
+   if (!threadCount) {
+      threadCount = MAX(1u, std::thread::hardware_concurrency());
+   }
+
+   auto out = new JobPool();
+   for (u32 i = 0; i < threadCount; ++i) {
+      out->threads.push_back(std::thread(_workerMain, out));
+   }
+   return out;
+}
+void jobPoolDestroy(JobPool *self) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->stopping = true;
+   }
+   self->jobReady.notify_all();
+
+   for (auto &t : self->threads) {
+      t.join();
+   }
+
+   delete self;
+}
+
+u32 jobPoolThreadCount(JobPool *self) {
+   return self ? (u32)self->threads.size() : 1;
+}
+
+void jobPoolPush(JobPool *self, std::function<void()> job) {
+   if (!self) {
+      job();
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->queue.push_back(std::move(job));
+      ++self->pending;
+   }
+   self->jobReady.notify_one();
+}
+
+void jobPoolWait(JobPool *self) {
+   if (!self) {
+      return;
+   }
+
+   while (true) {
+      if (_helpOne(self)) {
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lk(self->lock);
+      if (!self->pending) {
+         return;
+      }
+      self->jobDone.wait(lk, [=] { return !self->pending || !self->queue.empty(); });
+   }
+}
+
+void jobPoolParallelFor(JobPool *self, u32 count, u32 grain, std::function<void(u32, u32)> const &fn) {
+   grain = MAX(1u, grain);
+
+   if (!self || count <= grain) {
+      for (u32 begin = 0; begin < count; begin += grain) {
+         fn(begin, MIN(count, begin + grain));
+      }
+      return;
+   }
+
+   std::atomic<u32> remaining((count + grain - 1) / grain);
+
+   for (u32 begin = 0; begin < count; begin += grain) {
+      u32 end = MIN(count, begin + grain);
+      jobPoolPush(self, [&, begin, end] {
+         fn(begin, end);
+         --remaining;
+      });
+   }
+
+   // help out until our ranges are done, other callers jobs may get run here too
+   while (remaining) {
+      if (_helpOne(self)) {
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lk(self->lock);
+      self->jobDone.wait(lk, [&] { return !remaining || !self->queue.empty(); });
+   }
+}
+
+static u32 g_globalThreadCount = 0;
+
+JobPool *jobPoolGlobal() {
+   static JobPool *pool = jobPoolCreate(g_globalThreadCount);
+   return pool;
+}
+void jobPoolGlobalSetThreadCount(u32 threadCount) {
+   g_globalThreadCount = threadCount;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "defs.h"
+
+#include <functional>
+
+// JobPools are a fixed set of worker threads pulling jobs FIFO off a shared queue
+// Waiting threads help run queued jobs so it's safe to wait from inside a job
+typedef struct JobPool JobPool;
+
+// threadCount of 0 uses every hardware thread
+JobPool *jobPoolCreate(u32 threadCount = 0);
+void jobPoolDestroy(JobPool *self);
+
+u32 jobPoolThreadCount(JobPool *self);
+
+void jobPoolPush(JobPool *self, std::function<void()> job);
+
+// blocks until every job pushed to the pool has finished
+void jobPoolWait(JobPool *self);
+
+// splits [0, count) into ranges of at most grain and calls fn(begin, end) across the pool
+// blocks until every range is done, passing a null pool runs it all on the calling thread
+void jobPoolParallelFor(JobPool *self, u32 count, u32 grain, std::function<void(u32, u32)> const &fn);
+
+// shared pool for the encoder and tools, created on first use
+JobPool *jobPoolGlobal();
+// thread count the shared pool is created with, 0 (the default) uses every hardware thread.
+// Only has an effect before jobPoolGlobal is first called
+void jobPoolGlobalSetThreadCount(u32 threadCount);
@@ -0,0 +1,131 @@
+#include "loader.h"
+#include "jobs.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_set>
+#include <chrono>
+#include <algorithm>
+
+struct LoaderCompletion {
+   LoadHandle handle;
+   std::function<void()> complete;
+};
+
+struct Loader {
+   JobPool *pool = nullptr;
+
+   std::mutex lock;
+   std::condition_variable workDone;
+   std::deque<LoaderCompletion> ready; // finished work, waiting on a pump
+   u32 working = 0;
+
+   // only touched by the pumping thread
+   std::unordered_set<LoadHandle> pending;
+   LoadHandle nextHandle = 1;
+};
+
+static Microseconds _now() {
+   using namespace std::chrono;
+   return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void _complete(Loader *self, LoaderCompletion &done) {
+   done.complete();
+   self->pending.erase(done.handle);
+}
+
+Loader *loaderCreate(JobPool *pool) {
+   auto out = new Loader();
+   out->pool = pool;
+   return out;
+}
+void loaderDestroy(Loader *self) {
+   {
+      std::unique_lock<std::mutex> lk(self->lock);
+      self->workDone.wait(lk, [&] { return !self->working; });
+   }
+
+   // completions can push more work
+   while (loaderPendingCount(self)) {
+      loaderPump(self, 0);
+      std::unique_lock<std::mutex> lk(self->lock);
+      self->workDone.wait(lk, [&] { return !self->working || !self->ready.empty(); });
+   }
+   delete self;
+}
+
+LoadHandle loaderPush(Loader *self, std::function<void()> work, std::function<void()> complete) {
+   auto handle = self->nextHandle++;
+   if (!self->nextHandle) {
+      self->nextHandle = 1;
+   }
+   self->pending.insert(handle);
+
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      ++self->working;
+   }
+
+   jobPoolPush(self->pool, [=]() {
+      work();
+
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->ready.push_back({ handle, complete });
+      --self->working;
+      self->workDone.notify_all();
+   });
+   return handle;
+}
+
+bool loaderPending(Loader *self, LoadHandle handle) {
+   return self->pending.count(handle) != 0;
+}
+u32 loaderPendingCount(Loader *self) {
+   return (u32)self->pending.size();
+}
+
+u32 loaderPump(Loader *self, Microseconds budget) {
+   auto start = _now();
+   u32 count = 0;
+
+   do {
+      LoaderCompletion done;
+      {
+         std::lock_guard<std::mutex> lk(self->lock);
+         if (self->ready.empty()) {
+            break;
+         }
+         done = std::move(self->ready.front());
+         self->ready.pop_front();
+      }
+
+      _complete(self, done);
+      ++count;
+   } while (_now() - start < budget);
+
+   return count;
+}
+
+void loaderFinish(Loader *self, LoadHandle handle) {
+   if (!loaderPending(self, handle)) {
+      return;
+   }
+
+   LoaderCompletion done;
+   {
+      std::unique_lock<std::mutex> lk(self->lock);
+      for (;;) {
+         auto found = std::find_if(self->ready.begin(), self->ready.end(), [&](LoaderCompletion const &c) { return c.handle == handle; });
+         if (found != self->ready.end()) {
+            done = std::move(*found);
+            self->ready.erase(found);
+            break;
+         }
+         self->workDone.wait(lk);
+      }
+   }
+
+   _complete(self, done);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "defs.h"
+
+#include <functional>
+#include <memory>
+
+// Loaders split loading in two: work runs on a JobPool and its completion runs back on the thread
+// that pumps the loader, so file IO, decoding and encoding stay off the main thread while anything
+// touching game state or GL happens at one known point in the frame.
+// Completions run in the order their work finished
+typedef struct Loader Loader;
+typedef struct JobPool JobPool;
+
+typedef u32 LoadHandle; // 0 is never a handle
+
+Loader *loaderCreate(JobPool *pool);
+// waits for outstanding work and runs every completion left so nothing is leaked
+void loaderDestroy(Loader *self);
+
+LoadHandle loaderPush(Loader *self, std::function<void()> work, std::function<void()> complete);
+
+// work returns a T that's handed to complete
+template<typename T>
+LoadHandle loaderLoad(Loader *self, std::function<T()> work, std::function<void(T)> complete) {
+   auto result = std::make_shared<T>();
+   return loaderPush(self,
+      [=]() { *result = work(); },
+      [=]() { complete(std::move(*result)); });
+}
+
+// true until handle's completion has run
+bool loaderPending(Loader *self, LoadHandle handle);
+u32 loaderPendingCount(Loader *self);
+
+// runs completions until budget has passed, always at least one if any are ready so a slow
+// completion can't stall the rest. Returns how many ran
+u32 loaderPump(Loader *self, Microseconds budget);
+
+// blocks until handle's work is done and runs its completion, for when something can't go on without it
+void loaderFinish(Loader *self, LoadHandle handle);
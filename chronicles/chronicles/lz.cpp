@@ -0,0 +1,170 @@
+#include "lz.h"
+
+#include <string.h>
+
+static const u32 LZ_MIN_MATCH = 4;
+static const u32 LZ_MAX_OFFSET = 0xFFFF;
+static const u32 LZ_HASH_BITS = 12;
+
+// keeps the matcher from reading the last few bytes 4 at a time
+static const u32 LZ_END_LITERALS = 5;
+
+static u32 _read32(byte const* p) {
+   u32 out;
+   memcpy(&out, p, sizeof(out));
+   return out;
+}
+
+static u32 _hash(byte const* p) {
+   return (_read32(p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+u32 lzCompressBound(u32 size) {
+   return size + size / 255 + 16;
+}
+
+// writes a length past the 15 that fit in the token
+static byte *_writeLength(byte *dst, u32 len) {
+   for (; len >= 255; len -= 255) {
+      *dst++ = 255;
+   }
+   *dst++ = (byte)len;
+   return dst;
+}
+
+static byte *_writeSequence(byte *dst, byte const* literals, u32 literalLen, u32 offset, u32 matchLen) {
+   auto token = dst++;
+   *token = (byte)(MIN(literalLen, 15u) << 4);
+   if (literalLen >= 15) {
+      dst = _writeLength(dst, literalLen - 15);
+   }
+
+   if (literalLen) {
+      memcpy(dst, literals, literalLen); // literals is null for empty input
+      dst += literalLen;
+   }
+
+   if (matchLen) {
+      *dst++ = (byte)offset;
+      *dst++ = (byte)(offset >> 8);
+
+      matchLen -= LZ_MIN_MATCH;
+      *token |= (byte)MIN(matchLen, 15u);
+      if (matchLen >= 15) {
+         dst = _writeLength(dst, matchLen - 15);
+      }
+   }
+   return dst;
+}
+
+u32 lzCompress(void const* src, u32 size, void* dst, u32 capacity) {
+   if (capacity < lzCompressBound(size)) {
+      return 0;
+   }
+
+   auto in = (byte const*)src;
+   auto inEnd = in + size;
+   auto out = (byte*)dst;
+
+   // greedy single probe matcher, positions are stored +1 so 0 means empty
+   u32 table[1 << LZ_HASH_BITS] = { 0 };
+
+   auto anchor = in;
+   auto pos = in;
+   auto matchLimit = size > LZ_END_LITERALS + LZ_MIN_MATCH ? inEnd - LZ_END_LITERALS : in;
+
+   while (pos + LZ_MIN_MATCH <= matchLimit) {
+      auto h = _hash(pos);
+      auto candidate = table[h];
+      table[h] = (u32)(pos - in) + 1;
+
+      if (candidate) {
+         auto ref = in + candidate - 1;
+         if ((u32)(pos - ref) <= LZ_MAX_OFFSET && _read32(ref) == _read32(pos)) {
+            auto len = LZ_MIN_MATCH;
+            while (pos + len < matchLimit && ref[len] == pos[len]) {
+               ++len;
+            }
+
+            out = _writeSequence(out, anchor, (u32)(pos - anchor), (u32)(pos - ref), len);
+            pos += len;
+            anchor = pos;
+            continue;
+         }
+      }
+      ++pos;
+   }
+
+   out = _writeSequence(out, anchor, (u32)(inEnd - anchor), 0, 0);
+   return (u32)(out - (byte*)dst);
+}
+
+// reads a continued length, false if it runs off the end
+static bool _readLength(byte const*& src, byte const* srcEnd, u32& len) {
+   byte b;
+   do {
+      if (src >= srcEnd) {
+         return false;
+      }
+      b = *src++;
+      len += b;
+   } while (b == 255);
+   return true;
+}
+
+bool lzDecompress(void const* src, u32 srcSize, void* dst, u32 dstSize) {
+   auto in = (byte const*)src;
+   auto inEnd = in + srcSize;
+   auto outBegin = (byte*)dst;
+   auto out = outBegin;
+   auto outEnd = out + dstSize;
+
+   while (in < inEnd) {
+      auto token = *in++;
+
+      u32 literalLen = token >> 4;
+      if (literalLen == 15 && !_readLength(in, inEnd, literalLen)) {
+         return false;
+      }
+      if (literalLen > (u32)(inEnd - in) || literalLen > (u32)(outEnd - out)) {
+         return false;
+      }
+      memcpy(out, in, literalLen);
+      in += literalLen;
+      out += literalLen;
+
+      if (in == inEnd) {
+         break; // final literals
+      }
+
+      if (inEnd - in < 2) {
+         return false;
+      }
+      u32 offset = in[0] | (in[1] << 8);
+      in += 2;
+
+      u32 matchLen = token & 15;
+      if (matchLen == 15 && !_readLength(in, inEnd, matchLen)) {
+         return false;
+      }
+      matchLen += LZ_MIN_MATCH;
+
+      if (!offset || offset > (u32)(out - outBegin) || matchLen > (u32)(outEnd - out)) {
+         return false;
+      }
+
+      auto ref = out - offset;
+      if (offset >= matchLen) {
+         memcpy(out, ref, matchLen);
+         out += matchLen;
+      }
+      else {
+         // overlapping, runs repeat the last offset bytes
+         for (u32 i = 0; i < matchLen; ++i) {
+            *out++ = *ref++;
+         }
+      }
+   }
+
+   return out == outEnd;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "defs.h"
+
+// Small LZ77 block codec in the style of LZ4, built for decompression speed over ratio.
+// A block is a run of sequences: [token][literal length...][literals][u16 offset][match length...]
+// token holds 4 bits each of literal and match length, 15 continues into following bytes.
+// The last sequence is literals only
+
+// worst case compressed size for size bytes of input
+u32 lzCompressBound(u32 size);
+
+// returns the compressed size, 0 if it didn't fit in capacity
+u32 lzCompress(void const* src, u32 size, void* dst, u32 capacity);
+
+// safe on corrupt input, false unless src decodes to exactly dstSize bytes
+bool lzDecompress(void const* src, u32 srcSize, void* dst, u32 dstSize);
@@ -1,6 +1,18 @@
 
 #include "app.h"
 
+// -sync none|file, see SaveSync
+static bool _parseSync(StringView name, SaveSync &out) {
+   static const StringView names[] = { "none", "file" };
+   for (u32 i = 0; i < LEN(names); ++i) {
+      if (!strcmp(name, names[i])) {
+         out = (SaveSync)i;
+         return true;
+      }
+   }
+   return false;
+}
+
 static void _parseArgs(int argc, char** argv, AppConfig &config) {
    auto begin = argv + 1;
    auto end = argv + argc;
@@ -9,6 +21,9 @@ static void _parseArgs(int argc, char** argv, AppConfig &config) {
       if (!strcmp(*arg, "-assets") && ++arg < end) {
          config.assetFolder = *arg;
       }
+      else if (!strcmp(*arg, "-sync") && ++arg < end) {
+         _parseSync(*arg, config.saveSync);
+      }
    }
 }
 
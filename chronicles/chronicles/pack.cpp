@@ -0,0 +1,204 @@
+#include "pack.h"
+#include "scf.h"
+#include "egabind.h"
+#include "chronwin.h"
+
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <vector>
+
+// Packs are [int version][dict of each AssetKind in order]
+// dicts keep their keys in a sorted table so a lookup is a binary search straight on the mapping
+static const i32 AssetPackVersion = 1;
+
+struct AssetPack {
+   SCFFile *file = nullptr;
+   SCFReader index[AssetKind_COUNT];
+
+   std::unordered_map<std::string, EGAPalette*> palettes;
+   std::unordered_map<std::string, EGATexture*> textures[2]; // textures and fonts
+   SCFBlobCache *maps = nullptr;
+};
+
+AssetPack *assetPackOpen(StringView path) {
+   auto file = scfOpenFile(path, SCFAccess_RANDOM);
+   if (!file) {
+      return nullptr;
+   }
+
+   // checked so a damaged pack fails where it's read instead of reading out of bounds,
+   // lists are validated as they're opened so only what's used gets faulted in
+   auto root = scfFileViewChecked(file);
+   auto version = scfReaderNull(root) ? nullptr : scfReadInt(root);
+   if (!version || *version != AssetPackVersion) {
+      scfCloseFile(file);
+      return nullptr;
+   }
+
+   auto out = new AssetPack();
+   out->file = file;
+   for (u32 i = 0; i < AssetKind_COUNT; ++i) {
+      out->index[i] = scfReadDict(root);
+   }
+   out->maps = scfBlobCacheCreate();
+   return out;
+}
+void assetPackClose(AssetPack *pack) {
+   assetPackRelease(pack);
+   scfBlobCacheDestroy(pack->maps);
+   scfCloseFile(pack->file);
+   delete pack;
+}
+
+void assetPackRelease(AssetPack *pack) {
+   for (auto &p : pack->palettes) {
+      delete p.second;
+   }
+   pack->palettes.clear();
+
+   for (auto &cache : pack->textures) {
+      for (auto &t : cache) {
+         egaTextureDestroy(t.second);
+      }
+      cache.clear();
+   }
+
+   scfBlobCacheClear(pack->maps);
+}
+
+u32 assetPackCount(AssetPack *pack, AssetKind kind) {
+   auto &index = pack->index[kind];
+   return scfReaderNull(index) ? 0 : scfReaderCount(index);
+}
+StringView assetPackNameAt(AssetPack *pack, AssetKind kind, u32 index) {
+   return scfDictKeyAt(pack->index[kind], index);
+}
+bool assetPackContains(AssetPack *pack, AssetKind kind, StringView name) {
+   return !scfReaderNull(scfDictFind(pack->index[kind], name));
+}
+
+template<typename T, typename Load>
+static T *_cached(std::unordered_map<std::string, T*> &cache, StringView name, Load load) {
+   auto found = cache.find(name);
+   if (found != cache.end()) {
+      return found->second;
+   }
+
+   auto out = load();
+   if (out) {
+      cache.insert({ name, out });
+   }
+   return out;
+}
+
+EGAPalette *assetPackPalette(AssetPack *pack, StringView name) {
+   return _cached(pack->palettes, name, [&]() -> EGAPalette* {
+      auto entry = scfDictFind(pack->index[AssetKind_PALETTE], name);
+      EGAPalette value;
+      if (scfReaderNull(entry) || !scfRead(entry, value)) {
+         return nullptr;
+      }
+      return new EGAPalette(value);
+   });
+}
+
+static EGATexture *_packTexture(AssetPack *pack, AssetKind kind, StringView name) {
+   return _cached(pack->textures[kind - AssetKind_TEXTURE], name, [&]() -> EGATexture* {
+      auto entry = scfDictFind(pack->index[kind], name);
+      return scfReaderNull(entry) ? nullptr : egaTextureReadSCF(entry);
+   });
+}
+EGATexture *assetPackTexture(AssetPack *pack, StringView name) {
+   return _packTexture(pack, AssetKind_TEXTURE, name);
+}
+EGATexture *assetPackFont(AssetPack *pack, StringView name) {
+   return _packTexture(pack, AssetKind_FONT, name);
+}
+
+byte const *assetPackMap(AssetPack *pack, StringView name, u32 *sizeOut) {
+   auto entry = scfDictFind(pack->index[AssetKind_MAP], name);
+   return scfReaderNull(entry) ? nullptr : scfReadCompressed(entry, pack->maps, sizeOut);
+}
+
+struct AssetPackBuilder {
+   std::map<std::string, EGAPalette> palettes;
+   std::map<std::string, EGATexture*> textures[2]; // textures and fonts, owned copies
+   std::map<std::string, std::vector<byte>> maps;
+};
+
+AssetPackBuilder *assetPackBuilderCreate() {
+   return new AssetPackBuilder();
+}
+void assetPackBuilderDestroy(AssetPackBuilder *builder) {
+   for (auto &textures : builder->textures) {
+      for (auto &t : textures) {
+         egaTextureDestroy(t.second);
+      }
+   }
+   delete builder;
+}
+
+void assetPackBuilderAddPalette(AssetPackBuilder *builder, StringView name, EGAPalette const &palette) {
+   builder->palettes[name] = palette;
+}
+
+static void _addTexture(AssetPackBuilder *builder, AssetKind kind, StringView name, EGATexture const *texture) {
+   auto &slot = builder->textures[kind - AssetKind_TEXTURE][name];
+   if (slot) {
+      egaTextureDestroy(slot);
+   }
+   slot = egaTextureCreateCopy(texture);
+}
+void assetPackBuilderAddTexture(AssetPackBuilder *builder, StringView name, EGATexture const *texture) {
+   _addTexture(builder, AssetKind_TEXTURE, name, texture);
+}
+void assetPackBuilderAddFont(AssetPackBuilder *builder, StringView name, EGATexture const *fontSheet) {
+   _addTexture(builder, AssetKind_FONT, name, fontSheet);
+}
+void assetPackBuilderAddMap(AssetPackBuilder *builder, StringView name, void const *data, u32 size) {
+   builder->maps[name].assign((byte const*)data, (byte const*)data + size);
+}
+
+bool assetPackBuilderWrite(AssetPackBuilder *builder, StringView path) {
+   // each dict goes out as soon as it's done so only the largest one is ever held, 
+   // written off to the side so a running game watching the pack never maps a partial one
+   auto tempPath = format("%s.tmp", path);
+   auto writer = scfWriterCreateStream(tempPath.c_str());
+   if (!writer) {
+      return false;
+   }
+
+   scfWriteInt(writer, AssetPackVersion);
+
+   scfWriteDictBegin(writer);
+   for (auto &p : builder->palettes) {
+      scfWriteDictKey(writer, p.first.c_str());
+      scfWrite(writer, p.second);
+   }
+   scfWriteDictEnd(writer);
+
+   for (auto &textures : builder->textures) {
+      scfWriteDictBegin(writer);
+      for (auto &t : textures) {
+         scfWriteDictKey(writer, t.first.c_str());
+         egaTextureWriteSCF(t.second, writer);
+      }
+      scfWriteDictEnd(writer);
+   }
+
+   scfWriteDictBegin(writer);
+   for (auto &m : builder->maps) {
+      scfWriteDictKey(writer, m.first.c_str());
+      scfWriteCompressed(writer, m.second.data(), (u32)m.second.size());
+   }
+   scfWriteDictEnd(writer);
+
+   auto written = scfWriterFinishStream(writer);
+   scfWriterDestroy(writer);
+   if (!written || !fileReplace(tempPath.c_str(), path)) {
+      remove(tempPath.c_str());
+      return false;
+   }
+   return true;
+}
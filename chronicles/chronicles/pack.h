@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ega.h"
+
+// AssetPacks are every asset the game ships in one SCF file, mapped instead of read in.
+// Each kind of asset has its own index of names, so opening a pack costs the same however many
+// assets it holds and nothing is read out of it until it's asked for.
+// Assets are materialized on first request and cached in the pack until it's released or closed
+typedef struct AssetPack AssetPack;
+
+enum AssetKind_ {
+   AssetKind_PALETTE = 0,
+   AssetKind_TEXTURE,
+   AssetKind_FONT,   // 256x112 font sheets, see egaFontFactoryCreate
+   AssetKind_MAP,    // opaque data, stored compressed
+   AssetKind_COUNT
+};
+typedef byte AssetKind;
+
+AssetPack *assetPackOpen(StringView path); // null if it's missing or not a pack of this version
+void assetPackClose(AssetPack *pack);
+
+// frees everything materialized so far, anything returned before is invalid after
+void assetPackRelease(AssetPack *pack);
+
+// names of each kind in sorted order, index < assetPackCount(pack, kind)
+u32 assetPackCount(AssetPack *pack, AssetKind kind);
+StringView assetPackNameAt(AssetPack *pack, AssetKind kind, u32 index);
+bool assetPackContains(AssetPack *pack, AssetKind kind, StringView name);
+
+// owned by the pack, null if name isn't in it
+EGAPalette *assetPackPalette(AssetPack *pack, StringView name);
+EGATexture *assetPackTexture(AssetPack *pack, StringView name);
+EGATexture *assetPackFont(AssetPack *pack, StringView name);
+byte const *assetPackMap(AssetPack *pack, StringView name, u32 *sizeOut);
+
+// AssetPackBuilders collect assets and write them out as a pack, assets are copied in
+typedef struct AssetPackBuilder AssetPackBuilder;
+AssetPackBuilder *assetPackBuilderCreate();
+void assetPackBuilderDestroy(AssetPackBuilder *builder);
+
+// adding a name twice replaces the first
+void assetPackBuilderAddPalette(AssetPackBuilder *builder, StringView name, EGAPalette const &palette);
+void assetPackBuilderAddTexture(AssetPackBuilder *builder, StringView name, EGATexture const *texture);
+void assetPackBuilderAddFont(AssetPackBuilder *builder, StringView name, EGATexture const *fontSheet);
+void assetPackBuilderAddMap(AssetPackBuilder *builder, StringView name, void const *data, u32 size);
+
+// false if the file couldn't be written
+bool assetPackBuilderWrite(AssetPackBuilder *builder, StringView path);
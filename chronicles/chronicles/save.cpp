@@ -0,0 +1,133 @@
+#include "save.h"
+#include "chronwin.h"
+#include "scf.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+struct Save {
+   std::string path;
+   SaveSerializer serialize;
+   std::vector<SaveDone> done;
+};
+
+struct SaveQueue {
+   std::thread thread;
+
+   std::mutex lock;
+   std::condition_variable saveReady;
+   std::condition_variable saveDone;
+   std::deque<Save> waiting; // one per path, never more than a handful so they're searched in place
+   bool writing = false;
+   bool stopping = false;
+   SaveSync sync = SaveSync_FILE;
+
+   SCFWriter *writer = nullptr; // only touched by the thread, reused so saves share its buffers
+};
+
+static u64 _write(SaveQueue *self, Save &save, SaveSync sync) {
+   scfWriterReset(self->writer);
+   if (!save.serialize(self->writer)) {
+      return 0;
+   }
+
+   u32 size = 0;
+   auto data = scfWriterFinish(self->writer, &size);
+   if (!data) {
+      return 0;
+   }
+
+   auto tempPath = save.path + ".tmp";
+   if (!fileWrite(tempPath.c_str(), data, size, sync != SaveSync_NONE) || 
+      !fileReplace(tempPath.c_str(), save.path.c_str())) {
+      remove(tempPath.c_str());
+      return 0;
+   }
+   return size;
+}
+
+static void _saveMain(SaveQueue *self) {
+   while (true) {
+      std::unique_lock<std::mutex> lk(self->lock);
+      self->saveReady.wait(lk, [=] { return self->stopping || !self->waiting.empty(); });
+
+      if (self->waiting.empty()) {
+         return; // stopping and drained
+      }
+
+      auto save = std::move(self->waiting.front());
+      self->waiting.pop_front();
+      auto sync = self->sync;
+      self->writing = true;
+      lk.unlock();
+
+      auto written = _write(self, save, sync);
+      for (auto &done : save.done) {
+         done(written);
+      }
+
+      lk.lock();
+      self->writing = false;
+      lk.unlock();
+      self->saveDone.notify_all();
+   }
+}
+
+SaveQueue *saveQueueCreate(SaveSync sync) {
+   auto out = new SaveQueue();
+   out->sync = sync;
+   out->writer = scfWriterCreate();
+   out->thread = std::thread(_saveMain, out);
+   return out;
+}
+void saveQueueDestroy(SaveQueue *self) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->stopping = true;
+   }
+   self->saveReady.notify_all();
+   self->thread.join();
+
+   scfWriterDestroy(self->writer);
+   delete self;
+}
+
+void saveQueueSetSync(SaveQueue *self, SaveSync sync) {
+   std::lock_guard<std::mutex> lk(self->lock);
+   self->sync = sync;
+}
+
+void saveQueuePush(SaveQueue *self, StringView path, SaveSerializer serialize, SaveDone done) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+
+      auto found = std::find_if(self->waiting.begin(), self->waiting.end(), [&](Save const &s) { return s.path == path; });
+      if (found == self->waiting.end()) {
+         Save save;
+         save.path = path;
+         self->waiting.push_back(std::move(save));
+         found = self->waiting.end() - 1;
+      }
+
+      found->serialize = std::move(serialize);
+      if (done) {
+         found->done.push_back(std::move(done));
+      }
+   }
+   self->saveReady.notify_one();
+}
+
+void saveQueueFlush(SaveQueue *self) {
+   std::unique_lock<std::mutex> lk(self->lock);
+   self->saveDone.wait(lk, [=] { return self->waiting.empty() && !self->writing; });
+}
+
+SaveQueue *saveQueueGlobal() {
+   static SaveQueue *queue = saveQueueCreate();
+   return queue;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "defs.h"
+
+#include <functional>
+
+// SaveQueues write files behind the caller. Each save is serialized and written on the queue's
+// own thread into <path>.tmp, which is then renamed over path, so neither readers nor a crash
+// ever see a partly written file.
+// Pushing a save for a path that already has one waiting replaces it, so a burst of changes to
+// one asset goes out as a single write of the latest
+typedef struct SaveQueue SaveQueue;
+typedef struct SCFWriter SCFWriter;
+
+// how far a save goes to survive the machine going down, not just the app
+enum SaveSync_ {
+   SaveSync_NONE = 0, // left to the OS, a power cut can leave the new file empty
+   SaveSync_FILE      // the temp file is flushed to disk before it's renamed in, the rename always writes through
+};
+typedef byte SaveSync;
+
+SaveQueue *saveQueueCreate(SaveSync sync = SaveSync_FILE);
+// writes everything still waiting first
+void saveQueueDestroy(SaveQueue *self);
+
+// applies to saves that haven't started yet
+void saveQueueSetSync(SaveQueue *self, SaveSync sync);
+
+// serialize writes the file into writer on the queue's thread, returning false to give up on the save.
+// done runs after it on the same thread with the size of the new file, 0 if path wasn't replaced.
+// The done of any save this one replaced runs along with it
+typedef std::function<bool(SCFWriter*)> SaveSerializer;
+typedef std::function<void(u64)> SaveDone;
+void saveQueuePush(SaveQueue *self, StringView path, SaveSerializer serialize, SaveDone done = nullptr);
+
+// blocks until every save pushed so far is written
+void saveQueueFlush(SaveQueue *self);
+
+// shared queue for the game and its assets, created on first use with SaveSync_FILE
+SaveQueue *saveQueueGlobal();
@@ -1,15 +1,83 @@
 #include "scf.h"
+#include "chronwin.h"
+#include "lz.h"
+#include "jobs.h"
 
+#include <stdlib.h>
+#include <stdio.h>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
 
+// v1 puts each list's type list ahead of its data
+// v2 puts it after so lists can be written in one pass and back-patched:
+//    list: [u32 listSize][u32 dataSize][data][type list, null terminated and padded to 4]
+//    the root list follows the header, listSize counts everything after itself
+//    the top two bits of dataSize are flags, so a list's own data stays under 1GB
+//    lists with SCF_OFFSET_TABLE_BIT set in dataSize end in [u32 offsets[count]][u32 count]
+//    dicts also set SCF_DICT_KEYS_BIT and put [u32 keyOffset][u32 valueIndex] per key, sorted, ahead of the offsets
+//    arrays are [SCFArrayHeader][elements] in the binary segment, padded in front so the elements
+//    land on their alignment within the document, the binary segment starts on the largest one
+//    compressed bytes are [SCFCompressedHeader][stored bytes], stored raw when storedSize == size
+// wide documents are v2 with a u64 for every u32 that grows with the document: the header's binary
+// segment offset, list headers, binary offsets in the data and everything in list tails.
+// The flag bits move to the top of the u64 dataSize. Ints, floats and the headers of entries in the
+// binary segment stay u32, so single blobs are still under 4GB
 static const u32 SCF_MAGIC_NUMBER = 373285619;
+static const u32 SCF_MAGIC_NUMBER_V2 = 373285620;
+static const u32 SCF_MAGIC_NUMBER_WIDE = 373285621;
 
 struct SCFHeader {
-   const u32 magic = SCF_MAGIC_NUMBER;
+   u32 magic = SCF_MAGIC_NUMBER_V2;
    u32 binarySegmentOffset = 0;
 };
 
+struct SCFHeaderWide {
+   u32 magic = SCF_MAGIC_NUMBER_WIDE;
+   u32 reserved = 0;
+   u64 binarySegmentOffset = 0;
+};
+
+static const u32 SCF_OFFSET_TABLE_BIT = 0x80000000;
+static const u32 SCF_DICT_KEYS_BIT = 0x40000000;
+static const u32 SCF_DATA_SIZE_MASK = ~(SCF_OFFSET_TABLE_BIT | SCF_DICT_KEYS_BIT);
+
+struct SCFListHeader {
+   u32 listSize = 0;
+   u32 dataSize = 0;
+};
+
+// a list header read from either width
+struct SCFListInfo {
+   u64 listSize;
+   u64 dataSize;
+   u32 flags; // SCF_OFFSET_TABLE_BIT and SCF_DICT_KEYS_BIT
+};
+
+struct SCFArrayHeader {
+   u32 count;
+   SCFArrayType type;
+   byte pad[3];
+};
+
+struct SCFCompressedHeader {
+   u32 storedSize;
+   u32 size;
+};
+
+static u32 _arrayTypeSize(SCFArrayType type) {
+   switch (type) {
+   case SCFArrayType_I8: return 1;
+   case SCFArrayType_I16: return 2;
+   case SCFArrayType_I32: return 4;
+   case SCFArrayType_F32: return 4;
+   case SCFArrayType_F64: return 8;
+   }
+   return 0;
+}
 
 static u32 _roundUp(u32 in) {
    return (in + 3) & ~3;
@@ -24,35 +92,139 @@ static u32 _dataOffset(SCFType const* typeList) {
    //_roundUp(tlist.size + 1) - (tlist.size);
 }
 
-static u32 _currentTypeSize(SCFReader const& view) {
+// sizes and offsets are words, u32 in compact documents and u64 in wide ones
+static u32 _wordSize(bool wide) {
+   return wide ? sizeof(u64) : sizeof(u32);
+}
+static u64 _loadWord(void const* pos, bool wide) {
+   if (wide) {
+      u64 out;
+      memcpy(&out, pos, sizeof(out));
+      return out;
+   }
+   return *(u32*)pos;
+}
+
+static u64 _binarySegmentOffset(SCFHeader* header, bool wide) {
+   return wide ? ((SCFHeaderWide*)header)->binarySegmentOffset : header->binarySegmentOffset;
+}
+static byte* _binary(SCFReader const& view) {
+   return (byte*)view.header + _binarySegmentOffset(view.header, view.wide);
+}
+
+static SCFListInfo _listInfo(byte const* list, bool wide) {
+   SCFListInfo out;
+   if (wide) {
+      auto dataSize = _loadWord(list + sizeof(u64), true);
+      out.listSize = _loadWord(list, true);
+      out.flags = (u32)(dataSize >> 32) & ~SCF_DATA_SIZE_MASK;
+      out.dataSize = dataSize & ~((u64)~SCF_DATA_SIZE_MASK << 32);
+   }
+   else {
+      auto lh = (SCFListHeader*)list;
+      out.listSize = lh->listSize;
+      out.flags = lh->dataSize & ~SCF_DATA_SIZE_MASK;
+      out.dataSize = lh->dataSize & SCF_DATA_SIZE_MASK;
+   }
+   return out;
+}
+
+// offset table entries and dict keys, which are [keyOffset][valueIndex] word pairs
+static u64 _tableOffset(SCFReader const& view, u32 index) {
+   return _loadWord((byte const*)view.offsetTable + (u64)index * _wordSize(view.wide), view.wide);
+}
+static u64 _dictKeyWord(SCFReader const& dict, u32 index, u32 field) {
+   return _loadWord((byte const*)dict.dictKeys + ((u64)index * 2 + field) * _wordSize(dict.wide), dict.wide);
+}
+
+static u64 _currentTypeSize(SCFReader const& view) {
    switch (*view.typeList) {
    case SCFType_NULL: return 0;
    case SCFType_INT: return sizeof(u32);
    case SCFType_FLOAT: return sizeof(f32);
-   case SCFType_STRING: return sizeof(u32);
-   case SCFType_BYTES: return sizeof(u32);
-   case SCFType_SUBLIST: return *(u32*)view.pos;
+   case SCFType_STRING: 
+   case SCFType_BYTES: 
+   case SCFType_ARRAY: 
+   case SCFType_COMPRESSED: return _wordSize(view.wide);
+   case SCFType_SUBLIST: 
+   case SCFType_DICT: return _wordSize(view.wide) + _loadWord(view.pos, view.wide);
    }
 
    return 0;
 }
 
+struct SCFValidator {
+   SCFHeader* header;
+   byte const* binary;
+   byte const* end;
+   bool wide;
+};
+static bool _validateList(SCFValidator const& v, byte const* list, byte const* limit, u32 depth);
+
+// list points at a list's leading size
+static SCFReader _openList(SCFHeader* header, byte* list, bool wide, void const* checkedEnd = nullptr) {
+   auto word = _wordSize(wide);
+   if (checkedEnd) {
+      SCFValidator v = { header, (byte const*)header + _binarySegmentOffset(header, wide), (byte const*)checkedEnd, wide };
+      if (!_validateList(v, list, list + word + _loadWord(list, wide), 0)) {
+         return {};
+      }
+   }
+
+   SCFReader out;
+   out.header = header;
+   out.wide = wide;
+
+   if (header->magic != SCF_MAGIC_NUMBER) {
+      auto info = _listInfo(list, wide);
+      out.pos = list + 2 * word;
+      out.typeList = (SCFType*)out.pos + info.dataSize;
+
+      if (info.flags & SCF_OFFSET_TABLE_BIT) {
+         auto countPos = list + word + info.listSize - word;
+         out.count = (u32)_loadWord(countPos, wide);
+         out.offsetTable = countPos - (u64)out.count * word;
+
+         if (info.flags & SCF_DICT_KEYS_BIT) {
+            out.dictKeys = (byte const*)out.offsetTable - (u64)out.count * 2 * word;
+         }
+      }
+   }
+   else {
+      out.typeList = list + sizeof(u32);
+      out.pos = (byte*)out.typeList + _dataOffset(out.typeList);
+   }
+
+   out.typeListBegin = out.typeList;
+   out.dataBegin = out.pos;
+   out.checkedEnd = checkedEnd;
+   return out;
+}
+
 SCFReader scfView(void const* scf) {
    if (!scf) {
       return {};
    }
 
    auto header = (SCFHeader*)scf;
-   if (header->magic != SCF_MAGIC_NUMBER) {
-      return {};
+   switch (header->magic) {
+   case SCF_MAGIC_NUMBER_V2: 
+      return _openList(header, (byte*)scf + sizeof(SCFHeader), false);
+   case SCF_MAGIC_NUMBER_WIDE:
+      return _openList(header, (byte*)scf + sizeof(SCFHeaderWide), true);
+   case SCF_MAGIC_NUMBER: {
+      // v1 root has no size, start the type list right after the header
+      SCFReader out;
+      out.header = header;
+      out.typeList = (SCFType*)(((byte*)scf) + sizeof(SCFHeader));
+      out.pos = (byte*)out.typeList + _dataOffset(out.typeList);
+      out.typeListBegin = out.typeList;
+      out.dataBegin = out.pos;
+      return out;
+   }
    }
 
-   SCFReader out;
-   out.header = header;
-   out.typeList = (SCFType*)(((byte*)scf) + sizeof(SCFHeader));
-   out.pos = (byte*)out.typeList + _dataOffset(out.typeList);
-
-   return out;
+   return {};
 }
 bool scfReaderNull(SCFReader const& view) {
    return !view.header;
@@ -65,6 +237,9 @@ SCFType scfReaderPeek(SCFReader const& view) {
    return *view.typeList;
 }
 u32 scfReaderRemaining(SCFReader const& view) {
+   if (view.offsetTable) {
+      return view.count - (u32)(view.typeList - view.typeListBegin);
+   }
    return (u32)strlen((StringView)view.typeList);
 }
 void scfReaderSkip(SCFReader& view) {   
@@ -72,19 +247,41 @@ void scfReaderSkip(SCFReader& view) {
    ++view.typeList;
 }
 
-SCFReader scfReadList(SCFReader& view) {
-   if (*view.typeList != SCFType_SUBLIST) { return {};  }
+u32 scfReaderCount(SCFReader const& view) {
+   if (view.offsetTable) {
+      return view.count;
+   }
+   return (u32)strlen((StringView)view.typeListBegin);
+}
+bool scfReaderSeek(SCFReader& view, u32 index) {
+   if (view.offsetTable) {
+      if (index >= view.count) {
+         return false;
+      }
 
-   u32 listSize = *(u32*)view.pos;
+      view.typeList = view.typeListBegin + index;
+      view.pos = (byte*)view.dataBegin + _tableOffset(view, index);
+      return true;
+   }
 
-   SCFReader out;
-   out.header = view.header;
-   out.typeList = (byte*)view.pos + sizeof(u32);
-   out.pos = (byte*)out.typeList + _dataOffset(out.typeList);
+   // no table, walk from the start
+   view.typeList = view.typeListBegin;
+   view.pos = view.dataBegin;
+   for (u32 i = 0; i < index; ++i) {
+      if (scfReaderAtEnd(view)) {
+         return false;
+      }
+      scfReaderSkip(view);
+   }
 
-   (byte*&)view.pos += sizeof(u32) + listSize;
-   ++view.typeList;
+   return !scfReaderAtEnd(view);
+}
+
+SCFReader scfReadList(SCFReader& view) {
+   if (*view.typeList != SCFType_SUBLIST) { return {};  }
 
+   auto out = _openList(view.header, (byte*)view.pos, view.wide, view.checkedEnd);
+   scfReaderSkip(view);
    return out;
 }
 i32 const* scfReadInt(SCFReader& view) {
@@ -101,53 +298,584 @@ f32 const* scfReadFloat(SCFReader& view) {
 }
 StringView scfReadString(SCFReader& view) {
    if (*view.typeList != SCFType_STRING) { return nullptr; }
-   auto offset = *(u32*)view.pos;
+   auto offset = _loadWord(view.pos, view.wide);
    scfReaderSkip(view);
-   return (StringView)((byte*)view.header + view.header->binarySegmentOffset + offset);
+   return (StringView)(_binary(view) + offset);
 }
 byte const* scfReadBytes(SCFReader& view, u32* sizeOut) {
    if (*view.typeList != SCFType_BYTES) { return nullptr; }
-   auto offset = *(u32*)view.pos;
+   auto offset = _loadWord(view.pos, view.wide);
    scfReaderSkip(view);
 
-   auto bin = (byte*)view.header + view.header->binarySegmentOffset + offset;
+   auto bin = _binary(view) + offset;
    *sizeOut = *(u32*)bin;
    return bin + sizeof(u32);
 }
 
+void const* scfReadArray(SCFReader& view, SCFArrayType type, u32* countOut) {
+   if (*view.typeList != SCFType_ARRAY) { return nullptr; }
+   auto offset = _loadWord(view.pos, view.wide);
+
+   auto ah = (SCFArrayHeader*)(_binary(view) + offset);
+   if (ah->type != type) { return nullptr; }
+   scfReaderSkip(view);
+
+   *countOut = ah->count;
+   return ah + 1;
+}
+
+// binary entries follow each other unpadded so the header is copied out, returns the stored bytes
+static byte const* _compressedHeader(SCFReader const& view, SCFCompressedHeader& ch) {
+   if (*view.typeList != SCFType_COMPRESSED) { return nullptr; }
+   auto entry = _binary(view) + _loadWord(view.pos, view.wide);
+   memcpy(&ch, entry, sizeof(ch));
+   return entry + sizeof(ch);
+}
+
+u32 scfReadCompressedSize(SCFReader const& view) {
+   SCFCompressedHeader ch;
+   return _compressedHeader(view, ch) ? ch.size : 0;
+}
+bool scfReadCompressed(SCFReader& view, void* buffer, u32 capacity) {
+   SCFCompressedHeader ch;
+   auto stored = _compressedHeader(view, ch);
+   if (!stored || capacity < ch.size) {
+      return false;
+   }
+
+   if (ch.storedSize == ch.size) {
+      memcpy(buffer, stored, ch.size);
+   }
+   else if (!lzDecompress(stored, ch.storedSize, buffer, ch.size)) {
+      return false;
+   }
+
+   scfReaderSkip(view);
+   return true;
+}
+
+struct SCFBlobCache {
+   std::mutex lock;
+   std::unordered_map<void const*, std::unique_ptr<byte[]>> blobs;
+};
+
+SCFBlobCache *scfBlobCacheCreate() {
+   return new SCFBlobCache();
+}
+void scfBlobCacheDestroy(SCFBlobCache *cache) {
+   delete cache;
+}
+void scfBlobCacheClear(SCFBlobCache *cache) {
+   std::lock_guard<std::mutex> lk(cache->lock);
+   cache->blobs.clear();
+}
+
+byte const* scfReadCompressed(SCFReader& view, SCFBlobCache* cache, u32* sizeOut) {
+   SCFCompressedHeader ch;
+   auto stored = _compressedHeader(view, ch);
+   if (!stored) {
+      return nullptr;
+   }
+
+   // raw blobs are already usable in place
+   if (ch.storedSize == ch.size) {
+      scfReaderSkip(view);
+      *sizeOut = ch.size;
+      return stored;
+   }
+
+   {
+      std::lock_guard<std::mutex> lk(cache->lock);
+      auto found = cache->blobs.find(stored);
+      if (found != cache->blobs.end()) {
+         scfReaderSkip(view);
+         *sizeOut = ch.size;
+         return found->second.get();
+      }
+   }
+
+   // decompress outside the lock, if two threads race on one blob the first one in wins
+   std::unique_ptr<byte[]> blob(new byte[MAX(1u, ch.size)]);
+   if (!lzDecompress(stored, ch.storedSize, blob.get(), ch.size)) {
+      return nullptr;
+   }
+
+   std::lock_guard<std::mutex> lk(cache->lock);
+   auto &slot = cache->blobs[stored];
+   if (!slot) {
+      slot = std::move(blob);
+   }
+
+   scfReaderSkip(view);
+   *sizeOut = ch.size;
+   return slot.get();
+}
+
+SCFReader scfReadDict(SCFReader& view) {
+   if (*view.typeList != SCFType_DICT) { return {}; }
+
+   auto out = _openList(view.header, (byte*)view.pos, view.wide, view.checkedEnd);
+   scfReaderSkip(view);
+   return out;
+}
+
+static StringView _dictKey(SCFReader const& dict, u32 index) {
+   return (StringView)_binary(dict) + _dictKeyWord(dict, index, 0);
+}
+static u32 _dictValueIndex(SCFReader const& dict, u32 index) {
+   return (u32)_dictKeyWord(dict, index, 1);
+}
+
+SCFReader scfDictFind(SCFReader const& dict, StringView key) {
+   if (!dict.dictKeys) {
+      return {};
+   }
+
+   u32 lo = 0, hi = dict.count;
+   while (lo < hi) {
+      auto mid = lo + (hi - lo) / 2;
+      auto cmp = strcmp(_dictKey(dict, mid), key);
+      if (!cmp) {
+         auto out = dict;
+         scfReaderSeek(out, _dictValueIndex(dict, mid));
+         return out;
+      }
+
+      if (cmp < 0) {
+         lo = mid + 1;
+      }
+      else {
+         hi = mid;
+      }
+   }
+
+   return {};
+}
+StringView scfDictKeyAt(SCFReader const& dict, u32 index) {
+   if (!dict.dictKeys || index >= dict.count) {
+      return nullptr;
+   }
+   return _dictKey(dict, index);
+}
+SCFReader scfDictValueAt(SCFReader const& dict, u32 index) {
+   if (!dict.dictKeys || index >= dict.count) {
+      return {};
+   }
+
+   auto out = dict;
+   scfReaderSeek(out, _dictValueIndex(dict, index));
+   return out;
+}
+
+SCFReader scfReadListAt(SCFReader const& view, u32 index) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadList(v) : SCFReader();
+}
+i32 const* scfReadIntAt(SCFReader const& view, u32 index) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadInt(v) : nullptr;
+}
+f32 const* scfReadFloatAt(SCFReader const& view, u32 index) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadFloat(v) : nullptr;
+}
+StringView scfReadStringAt(SCFReader const& view, u32 index) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadString(v) : nullptr;
+}
+byte const* scfReadBytesAt(SCFReader const& view, u32 index, u32* sizeOut) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadBytes(v, sizeOut) : nullptr;
+}
+void const* scfReadArrayAt(SCFReader const& view, u32 index, SCFArrayType type, u32* countOut) {
+   auto v = view;
+   return scfReaderSeek(v, index) ? scfReadArray(v, type, countOut) : nullptr;
+}
+
+std::vector<SCFReader> scfReaderSpans(SCFReader const& view) {
+   std::vector<SCFReader> out;
+   out.reserve(scfReaderRemaining(view));
+
+   auto entry = view;
+   while (!scfReaderAtEnd(entry)) {
+      out.push_back(entry);
+      scfReaderSkip(entry);
+   }
+   return out;
+}
+
+void scfReaderParallelFor(JobPool* pool, SCFReader const& view, std::function<void(SCFReader&, u32)> const& fn, u32 grain) {
+   auto spans = scfReaderSpans(view);
+   jobPoolParallelFor(pool, (u32)spans.size(), grain, [&](u32 begin, u32 end) {
+      for (u32 i = begin; i < end; ++i) {
+         fn(spans[i], i);
+      }
+   });
+}
+
+#pragma region Validation
+
+// Every size and offset is checked against the region it has to fit in before it's followed.
+// Lists also have to agree with themselves: offset tables must match where the elements
+// really are and dict keys must point at real elements, so seeks and lookups stay in bounds
+static const u32 SCF_MAX_DEPTH = 256;
+
+static bool _fits(byte const* pos, u64 size, byte const* end) {
+   return pos <= end && size <= (u64)(end - pos);
+}
+
+// binary segment references, offset is from the start of the segment
+static bool _validateString(SCFValidator const& v, u64 offset) {
+   return _fits(v.binary, offset, v.end) && memchr(v.binary + offset, 0, v.end - (v.binary + offset));
+}
+static bool _validateBytes(SCFValidator const& v, u64 offset) {
+   return _fits(v.binary, offset + sizeof(u32), v.end)
+      && _fits(v.binary + offset + sizeof(u32), *(u32*)(v.binary + offset), v.end);
+}
+static bool _validateCompressed(SCFValidator const& v, u64 offset) {
+   if (!_fits(v.binary, offset + sizeof(SCFCompressedHeader), v.end)) {
+      return false;
+   }
+
+   // the payload itself is only checked by the decompressor
+   SCFCompressedHeader ch;
+   memcpy(&ch, v.binary + offset, sizeof(ch));
+   return _fits(v.binary + offset + sizeof(ch), ch.storedSize, v.end);
+}
+static bool _validateArray(SCFValidator const& v, u64 offset) {
+   if (!_fits(v.binary, offset + sizeof(SCFArrayHeader), v.end)) {
+      return false;
+   }
+
+   auto ah = (SCFArrayHeader*)(v.binary + offset);
+   return ah->type < SCFArrayType_COUNT
+      && _fits((byte const*)(ah + 1), (u64)ah->count * _arrayTypeSize(ah->type), v.end);
+}
+
+// checks one v2 or wide list inside [list, limit), and with depth also everything under it
+static bool _validateList(SCFValidator const& v, byte const* list, byte const* limit, u32 depth) {
+   auto word = _wordSize(v.wide);
+   if (!_fits(list, 2 * word, limit)) {
+      return false;
+   }
+
+   auto info = _listInfo(list, v.wide);
+   if (!_fits(list + word, info.listSize, limit)) {
+      return false;
+   }
+
+   auto listEnd = list + word + info.listSize;
+   auto data = list + 2 * word;
+   if (!_fits(data, info.dataSize, listEnd)) {
+      return false;
+   }
+
+   auto typeList = data + info.dataSize;
+   auto terminator = (byte const*)memchr(typeList, 0, listEnd - typeList);
+   if (!terminator) {
+      return false;
+   }
+   auto typeCount = (u32)(terminator - typeList);
+   auto tail = typeList + _roundUp(typeCount + 1);
+   if (tail > listEnd) {
+      return false;
+   }
+
+   byte const* offsets = nullptr;
+   byte const* keys = nullptr;
+   if (info.flags & SCF_OFFSET_TABLE_BIT) {
+      auto tableSize = ((u64)typeCount + 1) * word;
+      if (info.flags & SCF_DICT_KEYS_BIT) {
+         tableSize += (u64)typeCount * 2 * word;
+      }
+      if (!_fits(tail, tableSize, listEnd) || _loadWord(listEnd - word, v.wide) != typeCount) {
+         return false;
+      }
+
+      offsets = listEnd - word - (u64)typeCount * word;
+      if (info.flags & SCF_DICT_KEYS_BIT) {
+         keys = offsets - (u64)typeCount * 2 * word;
+      }
+   }
+   else if (info.flags & SCF_DICT_KEYS_BIT) {
+      return false;
+   }
+
+   auto pos = data;
+   for (u32 i = 0; i < typeCount; ++i) {
+      if (offsets && _loadWord(offsets + (u64)i * word, v.wide) != (u64)(pos - data)) {
+         return false;
+      }
+
+      auto type = typeList[i];
+      auto isNumber = type == SCFType_INT || type == SCFType_FLOAT;
+      u64 size = isNumber ? sizeof(u32) : word;
+      if (!_fits(pos, size, typeList)) {
+         return false;
+      }
+
+      auto value = isNumber ? 0 : _loadWord(pos, v.wide);
+      switch (type) {
+      case SCFType_INT:
+      case SCFType_FLOAT:
+         break;
+      case SCFType_STRING:
+         if (!_validateString(v, value)) { return false; }
+         break;
+      case SCFType_BYTES:
+         if (!_validateBytes(v, value)) { return false; }
+         break;
+      case SCFType_ARRAY:
+         if (!_validateArray(v, value)) { return false; }
+         break;
+      case SCFType_COMPRESSED:
+         if (!_validateCompressed(v, value)) { return false; }
+         break;
+      case SCFType_SUBLIST:
+      case SCFType_DICT:
+         if (!_fits(pos + word, value, typeList)) {
+            return false;
+         }
+         size += value;
+         if (depth && !_validateList(v, pos, pos + size, depth - 1)) {
+            return false;
+         }
+         break;
+      default:
+         return false;
+      }
+
+      pos += size;
+   }
+
+   for (u32 i = 0; keys && i < typeCount; ++i) {
+      auto key = keys + (u64)i * 2 * word;
+      if (_loadWord(key + word, v.wide) >= typeCount || !_validateString(v, _loadWord(key, v.wide))) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+// fills v and returns the root list, null if the header is bad
+static byte* _validateHeader(void const* scf, u64 size, SCFValidator& v) {
+   if (!scf || size < sizeof(SCFHeader)) {
+      return nullptr;
+   }
+
+   auto header = (SCFHeader*)scf;
+   v.wide = header->magic == SCF_MAGIC_NUMBER_WIDE;
+   if (!v.wide && header->magic != SCF_MAGIC_NUMBER_V2) {
+      return nullptr;
+   }
+
+   u64 headerSize = v.wide ? sizeof(SCFHeaderWide) : sizeof(SCFHeader);
+   if (size < headerSize) {
+      return nullptr;
+   }
+
+   auto binaryOffset = _binarySegmentOffset(header, v.wide);
+   if (binaryOffset < headerSize || binaryOffset > size) {
+      return nullptr;
+   }
+
+   v.header = header;
+   v.binary = (byte const*)scf + binaryOffset;
+   v.end = (byte const*)scf + size;
+   return (byte*)scf + headerSize;
+}
+
+bool scfValidate(void const* scf, u64 size) {
+   SCFValidator v;
+   auto root = _validateHeader(scf, size, v);
+   return root && _validateList(v, root, v.binary, SCF_MAX_DEPTH);
+}
+
+SCFReader scfViewChecked(void const* scf, u64 size) {
+   SCFValidator v;
+   auto root = _validateHeader(scf, size, v);
+
+   // the root is bounded by the data segment rather than its own size
+   if (!root || !_validateList(v, root, v.binary, 0)) {
+      return {};
+   }
+
+   auto out = _openList(v.header, root, v.wide);
+   out.checkedEnd = v.end;
+   return out;
+}
+
+#pragma endregion
+
+struct SCFFile {
+   MappedFile *mapping = nullptr;
+   SCFReader root;
+};
+
+SCFFile *scfOpenFile(StringView path, SCFAccess access) {
+   FileAccess fileAccess = FileAccess_NORMAL;
+   switch (access) {
+   case SCFAccess_SEQUENTIAL: fileAccess = FileAccess_SEQUENTIAL; break;
+   case SCFAccess_RANDOM: fileAccess = FileAccess_RANDOM; break;
+   }
+
+   auto mapping = fileMapReadOnly(path, fileAccess);
+   if (!mapping) {
+      return nullptr;
+   }
+
+   // the header and root list header are checked so opening a damaged file can't read past the mapping,
+   // values are up to the reader
+   auto checked = scfViewChecked(mappedFileData(mapping), mappedFileSize(mapping));
+   auto root = scfReaderNull(checked) ? checked : scfView(mappedFileData(mapping));
+   if (scfReaderNull(root)) {
+      fileUnmap(mapping);
+      return nullptr;
+   }
+
+   auto out = new SCFFile();
+   out->mapping = mapping;
+   out->root = root;
+   return out;
+}
+void scfCloseFile(SCFFile *file) {
+   fileUnmap(file->mapping);
+   delete file;
+}
+SCFReader scfFileView(SCFFile *file) {
+   return file->root;
+}
+u64 scfFileSize(SCFFile *file) {
+   return mappedFileSize(file->mapping);
+}
+bool scfFileValidate(SCFFile *file) {
+   return scfValidate(mappedFileData(file->mapping), mappedFileSize(file->mapping));
+}
+SCFReader scfFileViewChecked(SCFFile *file) {
+   return scfViewChecked(mappedFileData(file->mapping), mappedFileSize(file->mapping));
+}
+
+// Buffers only ever grow and are kept across scfWriterReset so a reused writer settles at zero allocations.
+// realloc lets the allocator extend in place instead of always copying.
+// A buffer that can't grow, past 4GB or out of memory, fails: it keeps what it had, drops
+// everything pushed after and the writer fails the document when it's finished
 struct SCFBuffer {
    byte* data = nullptr;
    u32 size = 0, capacity = 0;
+   bool failed = false;
+
+   bool grow(u32 count) {
+      u64 needed = (u64)size + count;
+      if (failed || needed > 0xFFFFFFFF) {
+         failed = true;
+         return false;
+      }
 
-   void grow(u32 count) {
-      if (capacity < size + count) {
-         capacity = (size+count) * 2;
-         byte* newBuff = new byte[capacity];
-         memcpy(newBuff, data, size);
-         delete[] data;
-         data = newBuff;
+      if (capacity < needed) {
+         auto newCapacity = (u32)MIN((u64)0xFFFFFFFF, MAX(64ull, needed * 2));
+         auto newData = (byte*)realloc(data, newCapacity);
+         if (!newData) {
+            failed = true;
+            return false;
+         }
+         data = newData;
+         capacity = newCapacity;
       }
+      return true;
    }
 
    void push(byte b) {
-      grow(1);
-      data[size++] = b;
+      if (grow(1)) {
+         data[size++] = b;
+      }
+   }
+   void push(byte const*buff, u32 len) {
+      if (grow(len)) {
+         memcpy(data + size, buff, len);
+         size += len;
+      }
    }
-   void push(byte*buff, u32 len) {
-      grow(len);
-      memcpy(data + size, buff, len);
-      size += len;
+   void destroy() {
+      ::free(data);
+      *this = {};
    }
 };
 
-struct SCFWriter {
-   std::vector<SCFBuffer> currentTypeList;
-   std::vector<SCFBuffer> currentDataSet;
+// Everything but the binary segment is written straight into output in order.
+// Open lists reserve their SCFListHeader and patch it on end, their type lists
+// are built on one shared stack and appended after their data
+struct SCFOpenList {
+   u64 headerOffset; // document position, only differs from the output offset when streaming
+   u32 typeListStart; // into typeStack
+   u32 offsetStart; // into offsetStack, only used with an offset table
+   u32 keyStart; // into keyStack, dicts only
+   SCFListFlags flags;
+   bool dict;
+};
 
-   SCFBuffer dataSegment;
+// open addressed set of strings already in the binary segment so repeats share an offset
+struct SCFStringSlot {
+   u32 hash;
+   u64 offset; // EMPTY_SLOT when unused
+};
+static const u64 EMPTY_SLOT = ~0ull;
+
+struct SCFKeyEntry {
+   u64 keyOffset;
+   u32 valueIndex;
+};
+
+struct SCFWriter {
+   SCFBuffer output;
+   SCFBuffer typeStack;
+   SCFBuffer offsetStack; // u64 element offsets for open lists with tables, same nesting as typeStack
    SCFBuffer binarySegment;
+   std::vector<SCFOpenList> lists;
+   std::vector<SCFKeyEntry> keyStack;
+   bool wide = false; // SCFFormat_WIDE
+
+   std::vector<SCFStringSlot> strings;
+   u32 stringCount = 0;
+   u64 bytesSaved = 0;
+
+   u32 binaryAlign = 4; // largest array alignment written, where the binary segment has to start
+   bool binaryAppended = false; // set once scfWriterFinish has moved the binary segment onto output
+
+   // Streaming writers flush output whenever only the root is open and spool the binary
+   // segment to a side file, so flushed and binarySpooled are how much has left memory
+   FILE* stream = nullptr;
+   FILE* binarySpool = nullptr;
+   std::string spoolPath;
+   u64 flushed = 0;
+   u64 binarySpooled = 0;
+   bool streamFailed = false;
+   bool failed = false; // something outgrew the format, the document fails when it's finished
 };
 
+static const u32 SCF_STREAM_CHUNK = 1 << 20;
+
+static bool _writerFailed(SCFWriter* writer) {
+   return writer->failed || writer->output.failed || writer->typeStack.failed || writer->offsetStack.failed || writer->binarySegment.failed;
+}
+
+static u64 _outputPos(SCFWriter* writer) {
+   return writer->flushed + writer->output.size;
+}
+static u64 _binaryPos(SCFWriter* writer) {
+   return writer->binarySpooled + writer->binarySegment.size;
+}
+
+static void _pushWord(SCFWriter* writer, SCFBuffer& buffer, u64 value) {
+   if (writer->wide) {
+      buffer.push((byte*)&value, sizeof(value));
+   }
+   else {
+      auto word = (u32)value;
+      buffer.push((byte*)&word, sizeof(word));
+   }
+}
+
 static StringView _typeName(SCFType type) {
    switch (type) {
    case SCFType_NULL: return "Null";
@@ -156,140 +884,550 @@ static StringView _typeName(SCFType type) {
    case SCFType_STRING: return "String";
    case SCFType_BYTES: return "Bytes";
    case SCFType_SUBLIST: return "Sublist";
+   case SCFType_DICT: return "Dict";
+   case SCFType_ARRAY: return "Array";
+   case SCFType_COMPRESSED: return "Compressed";
    }
    return "Unknown";
 }
 #include <imgui.h>
 void DEBUG_imShowWriterStats(SCFWriter *writer) {
-   ImGui::Text("List stack size: %d", writer->currentTypeList.size());
+   ImGui::Text("List stack size: %d", writer->lists.size());
 
    if (ImGui::TreeNode("Current Type List")) {
-      auto &l = writer->currentTypeList.back();
-      for (u32 i = 0; i < l.size; ++i) {
-         ImGui::Text(_typeName(l.data[i]));
+      // the stack is empty once the writer's finished
+      if (!writer->lists.empty()) {
+         auto &l = writer->lists.back();
+         for (u32 i = l.typeListStart; i < writer->typeStack.size; ++i) {
+            ImGui::Text(_typeName(writer->typeStack.data[i]));
+         }
       }
       ImGui::TreePop();
    }
 
-   ImGui::Text("Current List Dataset Size: %d", writer->currentDataSet.back().size);
+   ImGui::Text("Output Size: %d", writer->output.size);
    ImGui::Text("Current Binary Segment Size: %d", writer->binarySegment.size);
+   ImGui::Text("Unique Strings: %d", writer->stringCount);
+   ImGui::Text("Bytes Saved by Deduplication: %llu", (unsigned long long)writer->bytesSaved);
 }
 
-SCFWriter* scfWriterCreate() {
-   auto out = new SCFWriter();
-   out->currentTypeList.push_back({});
-   out->currentDataSet.push_back({});
-   return out;
+static u32 _hashString(StringView str, u32 *lenOut) {
+   // FNV-1a
+   u32 hash = 2166136261u;
+   auto c = str;
+   for (; *c; ++c) {
+      hash = (hash ^ (byte)*c) * 16777619u;
+   }
+   *lenOut = (u32)(c - str);
+   return hash;
 }
-void scfWriterDestroy(SCFWriter* writer) {
 
-   for (auto &l : writer->currentTypeList) {
-      if (l.data) { delete[] l.data; }
+static void _stringsClear(SCFWriter* writer) {
+   for (auto &slot : writer->strings) {
+      slot.offset = EMPTY_SLOT;
    }
+   writer->stringCount = 0;
+}
 
-   for (auto &l : writer->currentDataSet) {
-      if (l.data) { delete[] l.data; }
+static void _stringsGrow(SCFWriter* writer) {
+   auto old = std::move(writer->strings);
+   writer->strings.assign(MAX((size_t)64, old.size() * 2), { 0, EMPTY_SLOT });
+
+   auto mask = (u32)writer->strings.size() - 1;
+   for (auto &slot : old) {
+      if (slot.offset != EMPTY_SLOT) {
+         auto i = slot.hash & mask;
+         while (writer->strings[i].offset != EMPTY_SLOT) {
+            i = (i + 1) & mask;
+         }
+         writer->strings[i] = slot;
+      }
    }
+}
 
-   delete writer;
+// returns the binary offset of string, adding it to the segment if it's new
+static u64 _internString(SCFWriter* writer, StringView string) {
+   if ((writer->stringCount + 1) * 2 > writer->strings.size()) {
+      _stringsGrow(writer);
+   }
+
+   u32 len = 0;
+   auto hash = _hashString(string, &len);
+   auto mask = (u32)writer->strings.size() - 1;
+   auto i = hash & mask;
+
+   while (true) {
+      auto &slot = writer->strings[i];
+      if (slot.offset == EMPTY_SLOT) {
+         break;
+      }
+      if (slot.hash == hash && !strcmp((StringView)writer->binarySegment.data + (slot.offset - writer->binarySpooled), string)) {
+         writer->bytesSaved += len + 1;
+         return slot.offset;
+      }
+      i = (i + 1) & mask;
+   }
+
+   auto offset = _binaryPos(writer);
+   writer->binarySegment.push((byte*)string, len + 1);
+   if (writer->binarySegment.failed) {
+      return offset;
+   }
+   writer->strings[i] = { hash, offset };
+   ++writer->stringCount;
+   return offset;
 }
 
-void scfWriteListBegin(SCFWriter* writer) {
-   writer->currentTypeList.back().push(SCFType_SUBLIST);
-   writer->currentTypeList.push_back({});
-   writer->currentDataSet.push_back({});
+static void _streamWrite(SCFWriter* writer, FILE* file, void const* data, u32 size) {
+   if (size && fwrite(data, 1, size, file) != size) {
+      writer->streamFailed = true;
+   }
 }
-void scfWriteListEnd(SCFWriter* writer) {
-   if (writer->currentTypeList.size() <= 1) {
+
+static void _streamSeek(FILE* file, u64 pos) {
+#ifdef _WIN32
+   _fseeki64(file, (i64)pos, SEEK_SET);
+#else
+   fseeko(file, (off_t)pos, SEEK_SET);
+#endif
+}
+
+// overwrites already written document bytes at pos, which may have been flushed
+static void _patch(SCFWriter* writer, u64 pos, void const* data, u32 size) {
+   if (writer->output.failed) {
+      return; // pos may be past what made it in
+   }
+   if (pos >= writer->flushed) {
+      memcpy(writer->output.data + (pos - writer->flushed), data, size);
       return;
    }
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
+   _streamSeek(writer->stream, pos);
+   _streamWrite(writer, writer->stream, data, size);
+   fseek(writer->stream, 0, SEEK_END);
+}
 
-   int padding = _roundUp(tlist.size + 1) - (tlist.size);
-   u32 listSize = tlist.size + padding + dSet.size;
+static void _streamFlushOutput(SCFWriter* writer) {
+   _streamWrite(writer, writer->stream, writer->output.data, writer->output.size);
+   writer->flushed += writer->output.size;
+   writer->output.size = 0;
+}
 
-   //we push our data onto the parents dataset
-   auto &parentSet = *(writer->currentDataSet.end() - 2);
-   parentSet.grow(sizeof(listSize) + listSize); // small optimization for a large growth
-   parentSet.push((byte*)&listSize, sizeof(listSize)); //push list size
-   parentSet.push((byte*)tlist.data, tlist.size); //push typelist
-   parentSet.push((byte*)"\0\0\0\0", padding); //push padding
-   parentSet.push((byte*)dSet.data, dSet.size); //push dataset
+// The binary segment can only leave memory while no dict is waiting to sort its keys
+// and the dedup table has to forget it since strings are compared against these bytes
+static void _streamSpoolBinary(SCFWriter* writer) {
+   _streamWrite(writer, writer->binarySpool, writer->binarySegment.data, writer->binarySegment.size);
+   writer->binarySpooled += writer->binarySegment.size;
+   writer->binarySegment.size = 0;
+   _stringsClear(writer);
+}
 
-   if (tlist.data) { delete[] tlist.data; }
-   if (dSet.data) { delete[] dSet.data; }
+// called after every top level value, everything but the open root is complete by then
+static void _endValue(SCFWriter* writer) {
+   if (!writer->stream || writer->lists.size() != 1) {
+      return;
+   }
 
-   writer->currentTypeList.erase(writer->currentTypeList.end() - 1);
-   writer->currentDataSet.erase(writer->currentDataSet.end() - 1);
+   if (writer->output.size >= SCF_STREAM_CHUNK) {
+      _streamFlushOutput(writer);
+   }
+   if (writer->binarySegment.size >= SCF_STREAM_CHUNK) {
+      _streamSpoolBinary(writer);
+   }
 }
-void scfWriteInt(SCFWriter* writer, i32 i) {
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
 
-   tlist.push(SCFType_INT);
-   dSet.push((byte*)&i, sizeof(i));
+// pads the data segment so the binary segment starts on binaryAlign
+static void _alignBinaryStart(SCFWriter* writer) {
+   static const byte zeroes[64] = { 0 };
+   auto align = writer->binaryAlign;
+   writer->output.push(zeroes, (align - (u32)(_outputPos(writer) & (align - 1))) & (align - 1));
 }
-void scfWriteFloat(SCFWriter* writer, f32 f) {
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
 
-   tlist.push(SCFType_FLOAT);
-   dSet.push((byte*)&f, sizeof(f));
+static void _beginList(SCFWriter* writer, SCFListFlags flags, bool dict = false) {
+   writer->lists.push_back({ _outputPos(writer), writer->typeStack.size, writer->offsetStack.size, (u32)writer->keyStack.size(), flags, dict });
+   _pushWord(writer, writer->output, 0); // listSize
+   _pushWord(writer, writer->output, 0); // dataSize
 }
-void scfWriteString(SCFWriter* writer, StringView string) {
-   u32 len = (u32)strlen(string) + 1;
-   u32 offset = writer->binarySegment.size;
 
-   writer->binarySegment.push((byte*)string, len); //push to binary segment
+// every value goes through here so lists with tables can record where it starts
+static void _beginValue(SCFWriter* writer, SCFType type) {
+   writer->typeStack.push(type);
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   tlist.push(SCFType_STRING);
-   dSet.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
+   auto &list = writer->lists.back();
+   if (list.flags & SCFListFlags_OFFSET_TABLE) {
+      u64 offset = _outputPos(writer) - list.headerOffset - 2 * _wordSize(writer->wide);
+      writer->offsetStack.push((byte*)&offset, sizeof(offset));
+   }
+}
+
+static void _endList(SCFWriter* writer) {
+   auto list = writer->lists.back();
+   writer->lists.pop_back();
+
+   auto &out = writer->output;
+   auto word = _wordSize(writer->wide);
+   auto typeCount = writer->typeStack.size - list.typeListStart;
+   u64 dataSize = _outputPos(writer) - list.headerOffset - 2 * word;
+   u32 flags = 0;
+
+   out.push(writer->typeStack.data + list.typeListStart, typeCount);
+   out.push((byte const*)"\0\0\0\0", _roundUp(typeCount + 1) - typeCount); // terminator and padding
+   writer->typeStack.size = list.typeListStart;
+
+   if (list.dict) {
+      auto keys = writer->keyStack.data() + list.keyStart;
+      auto keyCount = (u32)writer->keyStack.size() - list.keyStart;
+      auto bin = (StringView)writer->binarySegment.data;
+      auto spooled = writer->binarySpooled; // nothing spools while a dict is open
+
+      std::sort(keys, keys + keyCount, [=](SCFKeyEntry const& a, SCFKeyEntry const& b) {
+         return strcmp(bin + (a.keyOffset - spooled), bin + (b.keyOffset - spooled)) < 0;
+      });
+
+      for (u32 i = 0; i < keyCount; ++i) {
+         _pushWord(writer, out, keys[i].keyOffset);
+         _pushWord(writer, out, keys[i].valueIndex);
+      }
+      writer->keyStack.resize(list.keyStart);
+      flags |= SCF_DICT_KEYS_BIT;
+   }
+
+   if (list.flags & SCFListFlags_OFFSET_TABLE) {
+      auto offsets = (u64*)(writer->offsetStack.data + list.offsetStart);
+      for (u32 i = 0; i < typeCount; ++i) {
+         _pushWord(writer, out, offsets[i]);
+      }
+      _pushWord(writer, out, typeCount);
+      writer->offsetStack.size = list.offsetStart;
+      flags |= SCF_OFFSET_TABLE_BIT;
+   }
+
+   u64 listSize = _outputPos(writer) - list.headerOffset - word;
+   if (writer->wide) {
+      u64 lh[] = { listSize, dataSize | ((u64)flags << 32) };
+      _patch(writer, list.headerOffset, lh, sizeof(lh));
+   }
+   else {
+      // past here dataSize runs into the flag bits and readers would misparse the list
+      if (dataSize > SCF_DATA_SIZE_MASK || listSize > 0xFFFFFFFF) {
+         writer->failed = true;
+      }
+
+      SCFListHeader lh;
+      lh.listSize = (u32)listSize;
+      lh.dataSize = (u32)dataSize | flags;
+      _patch(writer, list.headerOffset, &lh, sizeof(lh));
+   }
+}
+
+static void _patchHeader(SCFWriter* writer, u64 binarySegmentOffset) {
+   if (writer->wide) {
+      SCFHeaderWide header;
+      header.binarySegmentOffset = binarySegmentOffset;
+      _patch(writer, 0, &header, sizeof(header));
+   }
+   else {
+      SCFHeader header;
+      header.binarySegmentOffset = (u32)binarySegmentOffset;
+      _patch(writer, 0, &header, sizeof(header));
+   }
+}
+
+static void _writerStart(SCFWriter* writer) {
+   if (writer->wide) {
+      SCFHeaderWide header;
+      writer->output.push((byte*)&header, sizeof(header));
+   }
+   else {
+      SCFHeader header;
+      writer->output.push((byte*)&header, sizeof(header));
+   }
+   _beginList(writer, SCFListFlags_NONE);
+}
+
+SCFWriter* scfWriterCreate(SCFFormat format) {
+   auto out = new SCFWriter();
+   out->wide = format == SCFFormat_WIDE;
+   _writerStart(out);
+   return out;
+}
+static void _streamClose(SCFWriter* writer) {
+   fclose(writer->stream);
+   fclose(writer->binarySpool);
+   remove(writer->spoolPath.c_str());
+   writer->stream = writer->binarySpool = nullptr;
+}
+
+SCFWriter* scfWriterCreateStream(StringView path, SCFFormat format) {
+   auto stream = fopen(path, "wb");
+   if (!stream) {
+      return nullptr;
+   }
+
+   std::string spoolPath = path;
+   spoolPath += ".spool";
+   auto spool = fopen(spoolPath.c_str(), "w+b");
+   if (!spool) {
+      fclose(stream);
+      return nullptr;
+   }
+
+   auto out = new SCFWriter();
+   out->stream = stream;
+   out->binarySpool = spool;
+   out->spoolPath = std::move(spoolPath);
+   out->wide = format == SCFFormat_WIDE;
+   _writerStart(out);
+   return out;
+}
+
+bool scfWriterFinishStream(SCFWriter* writer) {
+   if (!writer->stream) {
+      return false;
+   }
+
+   while (!writer->lists.empty()) {
+      _endList(writer);
+   }
+   _alignBinaryStart(writer);
+   _streamFlushOutput(writer);
+   auto binarySegmentOffset = writer->flushed;
+
+   // copy the spool back over in output sized pieces, then whatever is still in memory
+   fflush(writer->binarySpool);
+   fseek(writer->binarySpool, 0, SEEK_SET);
+   auto &chunk = writer->output;
+   if (!chunk.grow(SCF_STREAM_CHUNK)) {
+      writer->streamFailed = true;
+   }
+   for (u64 left = writer->binarySpooled; left && !writer->streamFailed;) {
+      auto size = (u32)fread(chunk.data, 1, (size_t)MIN(left, (u64)SCF_STREAM_CHUNK), writer->binarySpool);
+      if (!size) {
+         writer->streamFailed = true;
+         break;
+      }
+      _streamWrite(writer, writer->stream, chunk.data, size);
+      left -= size;
+   }
+   _streamWrite(writer, writer->stream, writer->binarySegment.data, writer->binarySegment.size);
+
+   _patchHeader(writer, binarySegmentOffset);
+
+   // compact offsets will have wrapped
+   if (!writer->wide && binarySegmentOffset + _binaryPos(writer) > 0xFFFFFFFF) {
+      writer->streamFailed = true;
+   }
+
+   auto ok = !writer->streamFailed && !_writerFailed(writer) && !fflush(writer->stream) && !ferror(writer->stream);
+   _streamClose(writer);
+   return ok;
+}
+
+void scfWriterDestroy(SCFWriter* writer) {
+   if (writer->stream) {
+      _streamClose(writer);
+   }
+   writer->output.destroy();
+   writer->typeStack.destroy();
+   writer->offsetStack.destroy();
+   writer->binarySegment.destroy();
+   delete writer;
+}
+
+void scfWriteListBegin(SCFWriter* writer, SCFListFlags flags) {
+   _beginValue(writer, SCFType_SUBLIST);
+   _beginList(writer, flags);
+}
+void scfWriteListEnd(SCFWriter* writer) {
+   if (writer->lists.size() <= 1) {
+      return;
+   }
+   _endList(writer);
+   _endValue(writer);
+}
+void scfWriteDictBegin(SCFWriter* writer) {
+   _beginValue(writer, SCFType_DICT);
+   _beginList(writer, SCFListFlags_OFFSET_TABLE, true);
+}
+void scfWriteDictKey(SCFWriter* writer, StringView key) {
+   auto &list = writer->lists.back();
+   if (!list.dict) {
+      return;
+   }
+
+   u32 valueIndex = writer->typeStack.size - list.typeListStart;
+   writer->keyStack.push_back({ _internString(writer, key), valueIndex });
+}
+void scfWriteDictEnd(SCFWriter* writer) {
+   if (writer->lists.size() <= 1 || !writer->lists.back().dict) {
+      return;
+   }
+   _endList(writer);
+   _endValue(writer);
+}
+void scfWriteInt(SCFWriter* writer, i32 i) {
+   _beginValue(writer, SCFType_INT);
+   writer->output.push((byte*)&i, sizeof(i));
+   _endValue(writer);
+}
+void scfWriteFloat(SCFWriter* writer, f32 f) {
+   _beginValue(writer, SCFType_FLOAT);
+   writer->output.push((byte*)&f, sizeof(f));
+   _endValue(writer);
+}
+void scfWriteString(SCFWriter* writer, StringView string) {
+   auto offset = _internString(writer, string); // repeated strings share one copy in the binary segment
+
+   _beginValue(writer, SCFType_STRING);
+   _pushWord(writer, writer->output, offset); // push binary offset into dataset
+   _endValue(writer);
 }
 void scfWriteBytes(SCFWriter* writer, void const* data, u32 size) {
-   u32 offset = writer->binarySegment.size;
+   auto offset = _binaryPos(writer);
 
    writer->binarySegment.push((byte*)&size, sizeof(size)); //push size value to binary
    writer->binarySegment.push((byte*)data, size); //push to binary segment
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   tlist.push(SCFType_BYTES);
-   dSet.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
+   _beginValue(writer, SCFType_BYTES);
+   _pushWord(writer, writer->output, offset); // push binary offset into dataset
+   _endValue(writer);
 }
 
-void* scfWriteToBuffer(SCFWriter* writer, u32* sizeOut) {
+void scfWriteArray(SCFWriter* writer, SCFArrayType type, void const* data, u32 count, u32 alignment) {
+   alignment = MIN(64u, MAX(4u, alignment));
+   writer->binaryAlign = MAX(writer->binaryAlign, alignment);
 
-   //first copy current list to main set
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   int padding = _roundUp(tlist.size + 1) - (tlist.size);
+   // positions are from the start of the binary segment, which starts aligned to binaryAlign
+   auto elementsPos = _binaryPos(writer) + sizeof(SCFArrayHeader);
+   auto pad = (alignment - (u32)(elementsPos & (alignment - 1))) & (alignment - 1);
+   if (writer->binarySegment.grow(pad)) {
+      memset(writer->binarySegment.data + writer->binarySegment.size, 0, pad);
+      writer->binarySegment.size += pad;
+   }
 
-   u32 listSize = tlist.size + padding + dSet.size;
+   auto offset = _binaryPos(writer);
+   SCFArrayHeader ah = { count, type };
+   writer->binarySegment.push((byte*)&ah, sizeof(ah));
+   writer->binarySegment.push((byte*)data, count * _arrayTypeSize(type));
 
-   writer->dataSegment.grow( listSize); // small optimization for a large growth
-   writer->dataSegment.push((byte*)tlist.data, tlist.size); //push typelist
-   writer->dataSegment.push((byte*)"\0\0\0\0", padding); //push padding
-   writer->dataSegment.push((byte*)dSet.data, dSet.size); //push dataset
+   _beginValue(writer, SCFType_ARRAY);
+   _pushWord(writer, writer->output, offset);
+   _endValue(writer);
+}
 
-   auto dataSize = writer->dataSegment.size;
-   auto binarySize = writer->binarySegment.size;
+void scfWriteCompressed(SCFWriter* writer, void const* data, u32 size) {
+   auto offset = _binaryPos(writer);
 
-   u32 totalSize = sizeof(SCFHeader) + dataSize + binarySize;
+   // compress straight into the binary segment and give back what wasn't used
+   auto &bin = writer->binarySegment;
+   auto bound = lzCompressBound(size);
+   if (!bin.grow(sizeof(SCFCompressedHeader) + bound)) {
+      _beginValue(writer, SCFType_COMPRESSED);
+      _pushWord(writer, writer->output, offset);
+      _endValue(writer);
+      return;
+   }
 
-   byte* out = new byte[totalSize];
-   memset(out, 0, totalSize);
+   SCFCompressedHeader ch;
+   auto stored = bin.data + bin.size + sizeof(ch);
+   ch.size = size;
+   ch.storedSize = lzCompress(data, size, stored, bound);
+   if (!ch.storedSize || ch.storedSize >= size) {
+      ch.storedSize = size;
+      memcpy(stored, data, size);
+   }
+   memcpy(bin.data + bin.size, &ch, sizeof(ch));
+   bin.size += sizeof(ch) + ch.storedSize;
 
-   SCFHeader header;
-   header.binarySegmentOffset = sizeof(SCFHeader) + dataSize;
+   _beginValue(writer, SCFType_COMPRESSED);
+   _pushWord(writer, writer->output, offset);
+   _endValue(writer);
+}
 
-   memcpy(out, (byte*)&header, sizeof(header));
-   memcpy(out + sizeof(header), writer->dataSegment.data, dataSize);
-   memcpy(out + header.binarySegmentOffset, writer->binarySegment.data, binarySize);
+void scfWriterReset(SCFWriter* writer) {
+   writer->output.size = 0;
+   writer->typeStack.size = 0;
+   writer->offsetStack.size = 0;
+   writer->binarySegment.size = 0;
+   writer->failed = writer->output.failed = writer->typeStack.failed = writer->offsetStack.failed = writer->binarySegment.failed = false;
+   writer->lists.clear();
+   writer->keyStack.clear();
+   writer->binaryAlign = 4;
+   writer->binaryAppended = false;
+   writer->bytesSaved = 0;
+   _stringsClear(writer);
+   _writerStart(writer);
+}
+
+// closes anything left open and points the header at where the binary segment goes,
+// false if the document failed along the way or doesn't fit in 4GB
+static bool _closeDocument(SCFWriter* writer, u32 *sizeOut) {
+   while (!writer->lists.empty()) {
+      _endList(writer);
+   }
+
+   auto &out = writer->output;
+   u64 size = out.size;
+   if (!writer->binaryAppended) {
+      _alignBinaryStart(writer);
+      _patchHeader(writer, out.size);
+      size += writer->binarySegment.size;
+   }
+
+   if (_writerFailed(writer) || size > 0xFFFFFFFF) {
+      *sizeOut = 0;
+      return false;
+   }
+   *sizeOut = (u32)size;
+   return true;
+}
+
+bool scfWriteToBuffer(SCFWriter* writer, void* buffer, u32 capacity, u32* sizeOut) {
+   u32 size = 0;
+   auto ok = _closeDocument(writer, &size);
+   *sizeOut = size;
+   if (!ok || capacity < size) {
+      return false;
+   }
+
+   auto &out = writer->output;
+   memcpy(buffer, out.data, out.size);
+   if (!writer->binaryAppended && writer->binarySegment.size) {
+      memcpy((byte*)buffer + out.size, writer->binarySegment.data, writer->binarySegment.size);
+   }
+   return true;
+}
 
-   *sizeOut = totalSize;
+void* scfWriteToBuffer(SCFWriter* writer, u32* sizeOut) {
+   u32 size = 0;
+   if (!_closeDocument(writer, &size)) {
+      *sizeOut = 0;
+      scfWriterReset(writer);
+      return nullptr;
+   }
+   auto out = new byte[size];
+   scfWriteToBuffer(writer, out, size, sizeOut);
+   scfWriterReset(writer);
    return out;
-}
\ No newline at end of file
+}
+
+void const* scfWriterFinish(SCFWriter* writer, u32* sizeOut) {
+   u32 size = 0;
+   if (!_closeDocument(writer, &size)) {
+      *sizeOut = 0;
+      return nullptr;
+   }
+
+   if (!writer->binaryAppended) {
+      writer->output.push(writer->binarySegment.data, writer->binarySegment.size);
+      writer->binaryAppended = true;
+   }
+
+   if (writer->output.failed) {
+      *sizeOut = 0;
+      return nullptr;
+   }
+
+   *sizeOut = writer->output.size;
+   return writer->output.data;
+}
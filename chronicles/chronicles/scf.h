@@ -4,6 +4,9 @@
 
 #include "defs.h"
 
+#include <vector>
+#include <functional>
+
 typedef struct SCFHeader SCFHeader;
 
 enum SCFType_ {
@@ -12,17 +15,50 @@ enum SCFType_ {
    SCFType_FLOAT,
    SCFType_STRING,
    SCFType_BYTES,
-   SCFType_SUBLIST
+   SCFType_SUBLIST,
+   SCFType_DICT,     // list of values with a table of keys sorted for binary search
+   SCFType_ARRAY,    // packed numeric elements in the binary segment
+   SCFType_COMPRESSED // bytes stored compressed, see lz.h
 };
 typedef byte SCFType;
 
+enum SCFArrayType_ {
+   SCFArrayType_I8 = 0,
+   SCFArrayType_I16,
+   SCFArrayType_I32,
+   SCFArrayType_F32,
+   SCFArrayType_F64,
+   SCFArrayType_COUNT
+};
+typedef byte SCFArrayType;
+
 struct SCFReader {
    SCFHeader* header = nullptr;
    SCFType* typeList = nullptr;
    void* pos = nullptr;
+
+   // start of the list this reader walks, for seeking
+   SCFType* typeListBegin = nullptr;
+   void* dataBegin = nullptr;
+
+   // lists written with SCFListFlags_OFFSET_TABLE have every element's offset from dataBegin
+   // these and the dict keys are u32 or u64 words depending on wide
+   void const* offsetTable = nullptr;
+   u32 count = 0; // only valid with an offset table, use scfReaderCount
+
+   void const* dictKeys = nullptr; // [keyOffset][valueIndex] sorted by key, dicts only
+   bool wide = false; // SCFFormat_WIDE document
+
+   void const* checkedEnd = nullptr; // end of the buffer on checked readers, which validate lists as they open
 };
 
 SCFReader scfView(void const* scf);
+
+// Readers trust the buffer, for untrusted input either validate the whole document once and read
+// it normally, or use a checked view which validates each list as it's opened so only what's read
+// gets checked. Lists that fail open as null readers. v1 documents never pass
+bool scfValidate(void const* scf, u64 size);
+SCFReader scfViewChecked(void const* scf, u64 size); // null if the header or root list is bad
 bool scfReaderNull(SCFReader const& view);
 bool scfReaderAtEnd(SCFReader const& view);
 
@@ -30,24 +66,143 @@ SCFType scfReaderPeek(SCFReader const& view);
 u32 scfReaderRemaining(SCFReader const& view);
 void scfReaderSkip(SCFReader& view);
 
+// random access, O(1) for lists with an offset table and a scan from the list's start otherwise
+u32 scfReaderCount(SCFReader const& view);
+bool scfReaderSeek(SCFReader& view, u32 index);
+
 SCFReader scfReadList(SCFReader& view);
 i32 const* scfReadInt(SCFReader& view);
 f32 const* scfReadFloat(SCFReader& view);
 StringView scfReadString(SCFReader& view);
 byte const* scfReadBytes(SCFReader& view, u32* sizeOut);
+// points straight at the elements, null if the next value isn't an array of type
+// elements keep the alignment they were written with as long as the document is loaded at
+// an address aligned at least as much, SCFFiles always are
+void const* scfReadArray(SCFReader& view, SCFArrayType type, u32* countOut);
+
+// Compressed bytes are only decompressed when read, either into the caller's buffer or once
+// into a cache. Other entries never touch them so seeking past them stays cheap
+u32 scfReadCompressedSize(SCFReader const& view); // decompressed size of the next value, 0 if it isn't compressed
+// false if it isn't compressed, doesn't fit in capacity or is corrupt, view only moves on success
+bool scfReadCompressed(SCFReader& view, void* buffer, u32 capacity);
+
+// Caches are keyed by where the data is in the document, use one per loaded document and
+// destroy or clear it before the document goes away. Safe to share between threads
+typedef struct SCFBlobCache SCFBlobCache;
+SCFBlobCache *scfBlobCacheCreate();
+void scfBlobCacheDestroy(SCFBlobCache *cache);
+void scfBlobCacheClear(SCFBlobCache *cache);
+// the result lives in cache until it's cleared, null if it isn't compressed or is corrupt
+byte const* scfReadCompressed(SCFReader& view, SCFBlobCache* cache, u32* sizeOut);
+
+// Dicts read like lists of their values in written order, and can also be searched by key
+// lookups run on the buffer directly and never allocate, duplicate keys find any one of them
+SCFReader scfReadDict(SCFReader& view);
+// returns a reader positioned at key's value, null if it isn't there
+SCFReader scfDictFind(SCFReader const& dict, StringView key);
+// walk keys in sorted order, index < scfReaderCount(dict)
+StringView scfDictKeyAt(SCFReader const& dict, u32 index);
+SCFReader scfDictValueAt(SCFReader const& dict, u32 index);
+
+// read element index without moving view, null if it's out of range or the wrong type
+SCFReader scfReadListAt(SCFReader const& view, u32 index);
+i32 const* scfReadIntAt(SCFReader const& view, u32 index);
+f32 const* scfReadFloatAt(SCFReader const& view, u32 index);
+StringView scfReadStringAt(SCFReader const& view, u32 index);
+byte const* scfReadBytesAt(SCFReader const& view, u32 index, u32* sizeOut);
+void const* scfReadArrayAt(SCFReader const& view, u32 index, SCFArrayType type, u32* countOut);
+
+// Spans are copies of a reader positioned at each of its remaining values, found from the type list
+// and the size prefixes alone without reading into any of them. Readers only ever read the
+// document so spans can be read independently from any thread
+std::vector<SCFReader> scfReaderSpans(SCFReader const& view);
+
+// calls fn(entry, index) for every remaining value of view across pool, blocking until all are done
+// grain is how many values each job takes, raise it when values are cheap to read
+typedef struct JobPool JobPool;
+void scfReaderParallelFor(JobPool* pool, SCFReader const& view, std::function<void(SCFReader&, u32)> const& fn, u32 grain = 1);
+
+// reads every remaining value with T fn(SCFReader&) across pool, results are in the values' order
+template<typename T, typename Fn>
+std::vector<T> scfReaderParallelMap(JobPool* pool, SCFReader const& view, Fn fn, u32 grain = 1) {
+   std::vector<T> out(scfReaderRemaining(view));
+   scfReaderParallelFor(pool, view, [&](SCFReader& entry, u32 index) {
+      out[index] = fn(entry);
+   }, grain);
+   return out;
+}
+
+// SCFFiles map a document read-only instead of reading it in, readers are valid until the file is closed
+enum SCFAccess_ {
+   SCFAccess_NORMAL = 0,
+   SCFAccess_SEQUENTIAL, // reading front to back
+   SCFAccess_RANDOM      // seeking and dict lookups into a large file
+};
+typedef byte SCFAccess;
+
+typedef struct SCFFile SCFFile;
+SCFFile *scfOpenFile(StringView path, SCFAccess access = SCFAccess_NORMAL); // null if it's missing or not SCF
+void scfCloseFile(SCFFile *file);
+SCFReader scfFileView(SCFFile *file);
+u64 scfFileSize(SCFFile *file);
+bool scfFileValidate(SCFFile *file);
+SCFReader scfFileViewChecked(SCFFile *file);
 
 typedef struct SCFWriter SCFWriter;
 
-SCFWriter* scfWriterCreate();
+// Compact documents use u32 sizes and offsets and top out at 4GB, with each list's own data under 1GB
+// since dicts and offset tables take the top bits of its size. Wide ones use u64 where it matters and
+// readers pick it up from the header. In memory writers are limited to 4GB either way, write bigger
+// wide documents with a streaming writer. Writers fail the document when it outgrows its format
+enum SCFFormat_ {
+   SCFFormat_COMPACT = 0,
+   SCFFormat_WIDE
+};
+typedef byte SCFFormat;
+
+SCFWriter* scfWriterCreate(SCFFormat format = SCFFormat_COMPACT);
 void scfWriterDestroy(SCFWriter* writer);
 
-void scfWriteListBegin(SCFWriter* writer);
+// Streaming writers send the document to path as it's written instead of holding it, flushing
+// whenever a top level value completes so memory is bounded by the largest one.
+// The binary segment spools to <path>.spool until scfWriterFinishStream copies it in.
+// Use scfWriterFinishStream in place of the functions below, streaming writers can't be reset
+SCFWriter* scfWriterCreateStream(StringView path, SCFFormat format = SCFFormat_COMPACT); // null if either file can't be created
+// closes any open lists and the file, false if anything failed to write. Destroy the writer after
+bool scfWriterFinishStream(SCFWriter* writer);
+
+enum SCFListFlags_ {
+   SCFListFlags_NONE = 0,
+   SCFListFlags_OFFSET_TABLE = (1 << 0), // store each element's offset for random access
+};
+typedef byte SCFListFlags;
+
+void scfWriteListBegin(SCFWriter* writer, SCFListFlags flags = SCFListFlags_NONE);
 void scfWriteListEnd(SCFWriter* writer);
+
+// write scfWriteDictKey before each value
+void scfWriteDictBegin(SCFWriter* writer);
+void scfWriteDictKey(SCFWriter* writer, StringView key);
+void scfWriteDictEnd(SCFWriter* writer);
 void scfWriteInt(SCFWriter* writer, i32 i);
 void scfWriteFloat(SCFWriter* writer, f32 f);
 void scfWriteString(SCFWriter* writer, StringView string);
 void scfWriteBytes(SCFWriter* writer, void const* data, u32 size);
+// one type byte for the whole array, alignment is a power of two up to 64
+void scfWriteArray(SCFWriter* writer, SCFArrayType type, void const* data, u32 count, u32 alignment = 16);
+// falls back to storing data as is when it doesn't compress
+void scfWriteCompressed(SCFWriter* writer, void const* data, u32 size);
+
+// discards the document but keeps all capacity, a reused writer stops allocating once it's warmed up
+void scfWriterReset(SCFWriter* writer);
 
+// These end the document, closing any lists left open. Reset the writer before starting another.
+// A writer that ran out of memory or past 4GB fails the document, the results are null/false with size 0
+// returns a new[] copy owned by the caller and resets the writer
 void* scfWriteToBuffer(SCFWriter* writer, u32* sizeOut);
+// copies into buffer if it fits, sizeOut always receives the size needed
+bool scfWriteToBuffer(SCFWriter* writer, void* buffer, u32 capacity, u32* sizeOut);
+// no copy, the result lives in the writer until it's reset or destroyed
+void const* scfWriterFinish(SCFWriter* writer, u32* sizeOut);
 
 void DEBUG_imShowWriterStats(SCFWriter *writer);
\ No newline at end of file
@@ -0,0 +1,301 @@
+#pragma once
+
+// Compile time bindings between C++ types and SCF
+// scfWrite and scfRead resolve entirely through templates so a bound struct compiles down to
+// its fields' reads and writes in order, with no virtual calls or type switches.
+//
+// Structs are lists of their fields in the order they're bound:
+//    struct Foo { i32 a; f32 b[4]; std::vector<Bar> bars; };
+//    SCF_BIND(Foo, SCF_FIELD(Foo, a), SCF_FIELD(Foo, b), SCF_FIELD(Foo, bars));
+// Reads stop early without failing if the list runs out, so fields can be appended later.
+// Trivially copyable structs can instead be stored as a single bytes value with SCF_BIND_BYTES.
+// Bindings are specializations, declare them at global scope before anything that contains them
+//
+// Integers and enums up to 32 bits are ints, 64 bit ones and f64 are 8 bytes values, f32 is a float,
+// strings are strings.
+// Fixed arrays and vectors of numbers are one typed array, of SCF_BIND_BYTES types one bytes value
+// and of anything else a list
+
+#include "scf.h"
+
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <string.h>
+
+template<typename T, typename Enable = void>
+struct SCFBind; // static void write(SCFWriter*, T const&), static bool read(SCFReader&, T&)
+
+template<typename T>
+void scfWrite(SCFWriter* writer, T const& value) {
+   SCFBind<T>::write(writer, value);
+}
+// false if the next value doesn't match, out may be partially read
+template<typename T>
+bool scfRead(SCFReader& view, T& out) {
+   return SCFBind<T>::read(view, out);
+}
+
+#pragma region Values
+
+template<typename T>
+struct SCFIsScalar : std::integral_constant<bool, std::is_integral<T>::value || std::is_enum<T>::value> {};
+
+// unsigned values go through i32 and come back with the same bits
+template<typename T>
+struct SCFBind<T, typename std::enable_if<SCFIsScalar<T>::value && sizeof(T) <= sizeof(i32)>::type> {
+   static void write(SCFWriter* writer, T value) {
+      scfWriteInt(writer, (i32)value);
+   }
+   static bool read(SCFReader& view, T& out) {
+      auto i = scfReadInt(view);
+      if (!i) {
+         return false;
+      }
+      out = (T)*i;
+      return true;
+   }
+};
+
+// there's no 64 bit scalar type so these are stored whole as bytes
+template<typename T>
+struct SCFBind<T, typename std::enable_if<(SCFIsScalar<T>::value && sizeof(T) == sizeof(u64)) || std::is_same<T, f64>::value>::type> {
+   static void write(SCFWriter* writer, T value) {
+      scfWriteBytes(writer, &value, sizeof(T));
+   }
+   static bool read(SCFReader& view, T& out) {
+      u32 size = 0;
+      auto bytes = scfReadBytes(view, &size);
+      if (!bytes || size != sizeof(T)) {
+         return false;
+      }
+      memcpy(&out, bytes, sizeof(T));
+      return true;
+   }
+};
+
+template<>
+struct SCFBind<f32> {
+   static void write(SCFWriter* writer, f32 value) {
+      scfWriteFloat(writer, value);
+   }
+   static bool read(SCFReader& view, f32& out) {
+      auto f = scfReadFloat(view);
+      if (!f) {
+         return false;
+      }
+      out = *f;
+      return true;
+   }
+};
+
+template<>
+struct SCFBind<std::string> {
+   static void write(SCFWriter* writer, std::string const& value) {
+      scfWriteString(writer, value.c_str());
+   }
+   static bool read(SCFReader& view, std::string& out) {
+      auto str = scfReadString(view);
+      if (!str) {
+         return false;
+      }
+      out = str;
+      return true;
+   }
+};
+
+// points into the document when read
+template<>
+struct SCFBind<StringView> {
+   static void write(SCFWriter* writer, StringView value) {
+      scfWriteString(writer, value);
+   }
+   static bool read(SCFReader& view, StringView& out) {
+      out = scfReadString(view);
+      return out != nullptr;
+   }
+};
+
+#pragma endregion
+
+#pragma region Sequences
+
+// element types stored as one typed array, unsigned types share the signed storage
+template<typename T> struct SCFArrayTypeOf : std::false_type {};
+template<SCFArrayType Type> struct SCFArrayTypeIs : std::true_type {
+   static const SCFArrayType type = Type;
+};
+template<> struct SCFArrayTypeOf<sbyte> : SCFArrayTypeIs<SCFArrayType_I8> {};
+template<> struct SCFArrayTypeOf<byte> : SCFArrayTypeIs<SCFArrayType_I8> {};
+template<> struct SCFArrayTypeOf<i16> : SCFArrayTypeIs<SCFArrayType_I16> {};
+template<> struct SCFArrayTypeOf<u16> : SCFArrayTypeIs<SCFArrayType_I16> {};
+template<> struct SCFArrayTypeOf<i32> : SCFArrayTypeIs<SCFArrayType_I32> {};
+template<> struct SCFArrayTypeOf<u32> : SCFArrayTypeIs<SCFArrayType_I32> {};
+template<> struct SCFArrayTypeOf<f32> : SCFArrayTypeIs<SCFArrayType_F32> {};
+template<> struct SCFArrayTypeOf<f64> : SCFArrayTypeIs<SCFArrayType_F64> {};
+
+// set by SCF_BIND_BYTES
+template<typename T> struct SCFBindBytes : std::false_type {};
+
+// Sequences write count elements from data, and read by asking storage(count, T*& dst)
+// for somewhere to put them, which returns false to reject the count
+template<typename T, typename Enable = void>
+struct SCFSequence {
+   static void write(SCFWriter* writer, T const* data, u32 count) {
+      scfWriteListBegin(writer);
+      for (u32 i = 0; i < count; ++i) {
+         scfWrite(writer, data[i]);
+      }
+      scfWriteListEnd(writer);
+   }
+   template<typename Storage>
+   static bool read(SCFReader& view, Storage storage) {
+      auto list = scfReadList(view);
+      T* dst = nullptr;
+      if (scfReaderNull(list) || !storage(scfReaderCount(list), dst)) {
+         return false;
+      }
+
+      for (u32 i = 0; !scfReaderAtEnd(list); ++i) {
+         if (!scfRead(list, dst[i])) {
+            return false;
+         }
+      }
+      return true;
+   }
+};
+
+template<typename T>
+struct SCFSequence<T, typename std::enable_if<SCFArrayTypeOf<T>::value>::type> {
+   static void write(SCFWriter* writer, T const* data, u32 count) {
+      scfWriteArray(writer, SCFArrayTypeOf<T>::type, data, count);
+   }
+   template<typename Storage>
+   static bool read(SCFReader& view, Storage storage) {
+      u32 count = 0;
+      auto src = scfReadArray(view, SCFArrayTypeOf<T>::type, &count);
+      T* dst = nullptr;
+      if (!src || !storage(count, dst)) {
+         return false;
+      }
+
+      memcpy(dst, src, count * sizeof(T));
+      return true;
+   }
+};
+
+template<typename T>
+struct SCFSequence<T, typename std::enable_if<SCFBindBytes<T>::value>::type> {
+   static void write(SCFWriter* writer, T const* data, u32 count) {
+      scfWriteBytes(writer, data, count * (u32)sizeof(T));
+   }
+   template<typename Storage>
+   static bool read(SCFReader& view, Storage storage) {
+      u32 size = 0;
+      auto src = scfReadBytes(view, &size);
+      T* dst = nullptr;
+      if (!src || size % sizeof(T) || !storage(size / (u32)sizeof(T), dst)) {
+         return false;
+      }
+
+      memcpy(dst, src, size);
+      return true;
+   }
+};
+
+template<typename T, size_t N>
+struct SCFBind<T[N]> {
+   static void write(SCFWriter* writer, T const (&value)[N]) {
+      SCFSequence<T>::write(writer, value, (u32)N);
+   }
+   static bool read(SCFReader& view, T (&out)[N]) {
+      return SCFSequence<T>::read(view, [&](u32 count, T*& dst) {
+         dst = out;
+         return count == N;
+      });
+   }
+};
+
+template<typename T>
+struct SCFBind<std::vector<T>> {
+   static void write(SCFWriter* writer, std::vector<T> const& value) {
+      SCFSequence<T>::write(writer, value.data(), (u32)value.size());
+   }
+   static bool read(SCFReader& view, std::vector<T>& out) {
+      return SCFSequence<T>::read(view, [&](u32 count, T*& dst) {
+         out.resize(count);
+         dst = out.data();
+         return true;
+      });
+   }
+};
+
+#pragma endregion
+
+#pragma region Structs
+
+template<typename MemberPtr, MemberPtr Member>
+struct SCFField;
+
+template<typename S, typename F, F S::*Member>
+struct SCFField<F S::*, Member> {
+   static void write(SCFWriter* writer, S const& value) {
+      scfWrite(writer, value.*Member);
+   }
+   static bool read(SCFReader& view, S& out) {
+      return scfRead(view, out.*Member);
+   }
+};
+
+template<typename... Fields>
+struct SCFFieldList {
+   template<typename S>
+   static void write(SCFWriter* writer, S const& value) {
+      int expand[] = { 0, (Fields::write(writer, value), 0)... };
+      (void)expand;
+   }
+   template<typename S>
+   static bool read(SCFReader& list, S& out) {
+      bool ok = true;
+      int expand[] = { 0, (ok = ok && (scfReaderAtEnd(list) || Fields::read(list, out)), 0)... };
+      (void)expand;
+      return ok;
+   }
+};
+
+#define SCF_FIELD(Type, name) SCFField<decltype(&Type::name), &Type::name>
+
+#define SCF_BIND(Type, ...)                                                \
+   template<> struct SCFBind<Type> {                                       \
+      typedef SCFFieldList<__VA_ARGS__> Fields;                            \
+      static void write(SCFWriter* writer, Type const& value) {            \
+         scfWriteListBegin(writer);                                        \
+         Fields::write(writer, value);                                     \
+         scfWriteListEnd(writer);                                          \
+      }                                                                    \
+      static bool read(SCFReader& view, Type& out) {                       \
+         auto list = scfReadList(view);                                    \
+         return !scfReaderNull(list) && Fields::read(list, out);           \
+      }                                                                    \
+   }
+
+#define SCF_BIND_BYTES(Type)                                               \
+   template<> struct SCFBindBytes<Type> : std::true_type {};               \
+   template<> struct SCFBind<Type> {                                       \
+      static_assert(std::is_trivially_copyable<Type>::value,               \
+         #Type " has to be trivially copyable to bind as bytes");          \
+      static void write(SCFWriter* writer, Type const& value) {            \
+         scfWriteBytes(writer, &value, sizeof(Type));                      \
+      }                                                                    \
+      static bool read(SCFReader& view, Type& out) {                       \
+         u32 size = 0;                                                     \
+         auto bytes = scfReadBytes(view, &size);                           \
+         if (!bytes || size != sizeof(Type)) {                             \
+            return false;                                                  \
+         }                                                                 \
+         memcpy(&out, bytes, sizeof(Type));                                \
+         return true;                                                      \
+      }                                                                    \
+   }
+
+#pragma endregion
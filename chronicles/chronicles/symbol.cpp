@@ -2,6 +2,7 @@
 
 #include <unordered_set>
 #include <cstring>
+#include <mutex>
 
 struct StringViewEqual {
    bool operator()(const StringView &lhs, const StringView &rhs) const {
@@ -20,8 +21,12 @@ struct StringViewHash {
    }
 };
 
+// loaders intern off the main thread
 Symbol intern(StringView str) {
    static std::unordered_set < StringView, StringViewHash, StringViewEqual > table;
+   static std::mutex lock;
+   std::lock_guard<std::mutex> lk(lock);
+
    auto search = table.find(str);
    if (search != table.end()) {
       return *search;
@@ -627,20 +627,21 @@ void uiPaletteEditor(Window* wnd, EGAPalette* pal, char* palName, u32 palNameSiz
          }
          ImGui::InputText(ICON_FA_SEARCH, search, 64);
 
-         auto pals = assetsPaletteGetList(game->assets, search);
-         *loadCursor = MIN(*loadCursor, MAX(0, pals.size()-1));
+         auto pals = assetsPaletteSearch(game->assets, search);
+         *loadCursor = MIN(*loadCursor, MAX(0, (int)pals.count - 1));
 
          if (ImGui::BeginChild("List", ImVec2(ImGui::GetContentRegionAvailWidth(), ImGui::GetFrameHeightWithSpacing() * 5), true)) {
 
-            if (pals.empty()) {
+            if (!pals.count) {
                ImGui::Text("No Palettes!");
             }
             else {
                auto &imStyle = ImGui::GetStyle();
                auto imBtnAlign = imStyle.ButtonTextAlign;
-               int palIdx = 0;
-               for (auto p : pals) {
-                  ImGui::PushID(p.c_str());
+               Symbol deleted = nullptr; // pals is a view into the index so deleting waits for the loop
+               for (int palIdx = 0; palIdx < (int)pals.count; ++palIdx) {
+                  auto p = pals.names[palIdx];
+                  ImGui::PushID(p);
 
                   bool btnDelete = ImGui::Button(ICON_FA_TRASH_ALT);
                   if (ImGui::IsItemHovered()) ImGui::SetTooltip("Delete");
@@ -649,7 +650,7 @@ void uiPaletteEditor(Window* wnd, EGAPalette* pal, char* palName, u32 palNameSiz
                   }
 
                   if (uiModalPopup("Delete Confirm", "Delete this palette?", uiModalTypes_YESNO, ICON_FA_EXCLAMATION_TRIANGLE) == uiModalResults_YES) {
-                     assetsPaletteDelete(game->assets, p.c_str());
+                     deleted = p;
                   }
 
                   if (palIdx == *loadCursor) {
@@ -658,17 +659,17 @@ void uiPaletteEditor(Window* wnd, EGAPalette* pal, char* palName, u32 palNameSiz
 
                   imStyle.ButtonTextAlign = ImVec2(0.f, 0.5f);
                   ImGui::SameLine();
-                  bool clicked = ImGui::Button(p.c_str(), ImVec2(ImGui::GetContentRegionAvailWidth(), 0));
+                  bool clicked = ImGui::Button(p, ImVec2(ImGui::GetContentRegionAvailWidth(), 0));
                   if (ImGui::IsItemHovered()) {
-                     if (auto apal = assetsPaletteRetrieve(game->assets, p.c_str())) {
+                     if (auto apal = assetsPaletteRetrieve(game->assets, p)) {
                         *pal = *apal;
                      }                     
                   }
                   if (clicked) {
-                     if (auto apal = assetsPaletteRetrieve(game->assets, p.c_str())) {
+                     if (auto apal = assetsPaletteRetrieve(game->assets, p)) {
                         *pal = *apal;
                      }
-                     strcpy(palName, p.c_str());
+                     strcpy(palName, p);
                      ImGui::CloseCurrentPopup();
                   }
                   imStyle.ButtonTextAlign = imBtnAlign;
@@ -678,15 +679,14 @@ void uiPaletteEditor(Window* wnd, EGAPalette* pal, char* palName, u32 palNameSiz
                   }
 
                   ImGui::PopID();
-                  ++palIdx;
                }
 
                if (ImGui::IsKeyPressed(SDL_SCANCODE_RETURN)) {
-                  auto &p = pals[*loadCursor];
-                  if (auto apal = assetsPaletteRetrieve(game->assets, p.c_str())) {
+                  auto p = pals.names[*loadCursor];
+                  if (auto apal = assetsPaletteRetrieve(game->assets, p)) {
                      *pal = *apal;
                   }
-                  strcpy(palName, p.c_str());
+                  strcpy(palName, p);
                   ImGui::CloseCurrentPopup();
                }
 
@@ -701,6 +701,10 @@ void uiPaletteEditor(Window* wnd, EGAPalette* pal, char* palName, u32 palNameSiz
                if (ImGui::IsKeyPressed(SDLK_ESCAPE)) {
                   ImGui::CloseCurrentPopup();
                }
+
+               if (deleted) {
+                  assetsPaletteDelete(game->assets, deleted);
+               }
             }
 
          }
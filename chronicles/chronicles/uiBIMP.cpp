@@ -2,6 +2,7 @@
 #include "game.h"
 #include "app.h"
 #include "chronwin.h"
+#include "loader.h"
 
 #include <imgui.h>
 
@@ -12,6 +13,8 @@
 #include <SDL2/SDL_scancode.h>
 #include <SDL2/SDL_mouse.h>
 
+#include <algorithm>
+
 #define MAX_IMG_DIM 0x100000
 
 #define POPUPID_COLORPICKER "egapicker"
@@ -49,6 +52,8 @@ struct BIMPState {
    EGAPalette palette;
    char palName[64];
 
+   EGAEncodeOptions encodeOptions;
+
    ToolStates toolState = ToolStates_NONE;
    EGAPColor popupCLickedColor = 0; // for color picker popup
    Float2 mousePos = { 0 }; //mouse positon within the image coords (updated per frame)
@@ -70,9 +75,17 @@ struct BIMPState {
 
    std::vector<EGATexture*> history;
    size_t historyPosition = 0;
+
+   // loads and encodes running on the game's loader, finished before the state is destroyed
+   std::vector<LoadHandle> loads;
+   u32 loadGeneration = 0; // bumped whenever the image is replaced so results for an older one are dropped
+   bool encoding = false;
+   bool encodeFailed = false;
 };
 
 static void _stateTexCleanup(BIMPState &state) {
+   ++state.loadGeneration;
+
    if (state.pngTex) {
       textureDestroy(state.pngTex);
       state.pngTex = nullptr;
@@ -108,6 +121,12 @@ static void _cleanupHistory(BIMPState &state) {
 }
 
 static void _stateDestroy(BIMPState &state) {
+   auto loader = gameGet()->loader;
+   for (auto handle : state.loads) {
+      loaderFinish(loader, handle);
+   }
+   state.loads.clear();
+
    _cleanupHistory(state);
    _stateTexCleanup(state);
 }
@@ -123,6 +142,8 @@ static void _exitRegionPicked(BIMPState &state) {
 }
 
 static void _resizeTextures(BIMPState &state, Int2 newSize) {
+   ++state.loadGeneration;
+
    if (state.pngTex) {
       textureDestroy(state.pngTex);
       state.pngTex = textureCreateCustom(newSize.x, newSize.y, {RepeatType_CLAMP, FilterType_NEAREST});
@@ -271,20 +292,103 @@ static std::string _getPng() {
 
 
 
+static void _trackLoad(BIMPState &state, LoadHandle handle) {
+   auto loader = gameGet()->loader;
+   state.loads.erase(std::remove_if(state.loads.begin(), state.loads.end(), [&](LoadHandle h) { return !loaderPending(loader, h); }), state.loads.end());
+   state.loads.push_back(handle);
+}
+
 static void _loadPNG(BIMPState &state) {
    auto png = _getPng();
    if (!png.empty()) {
-      
-      _stateTexCleanup(state);
-      state.pngTex = textureCreateFromPath(png.c_str(), { RepeatType_CLAMP, FilterType_NEAREST });      
+      auto statePtr = &state;
+      auto generation = ++state.loadGeneration;
+
+      // decoded on the loader, the current image stays up until it's done
+      _trackLoad(state, loaderLoad<Texture*>(gameGet()->loader,
+         [=]() { return textureLoadFromPath(png.c_str(), { RepeatType_CLAMP, FilterType_NEAREST }); },
+         [=](Texture *tex) {
+            auto &state = *statePtr;
+            if (generation != state.loadGeneration) {
+               if (tex) { textureDestroy(tex); }
+               return;
+            }
+            if (!tex) {
+               return;
+            }
+
+            _stateTexCleanup(state);
+            state.pngTex = tex;
 
-      auto palName = pathGetFilename(png.c_str());
-      strcpy(state.palName, palName.c_str());
+            auto palName = pathGetFilename(png.c_str());
+            strcpy(state.palName, palName.c_str());
 
-      _fitToWindow(state);
+            _fitToWindow(state);
+         }));
    }
 }
 
+struct BIMPEncodeResult {
+   EGATexture *ega = nullptr;
+   EGAPalette palette = { 0 };
+};
+
+static void _encode(BIMPState &state) {
+   // the encode works on a copy so the source can be closed or replaced meanwhile
+   auto size = textureGetSize(state.pngTex);
+   auto source = textureCreateCustom(size.x, size.y, { RepeatType_CLAMP, FilterType_NEAREST });
+   textureSetPixels(source, (byte*)textureGetPixels(state.pngTex));
+
+   auto statePtr = &state;
+   auto generation = state.loadGeneration;
+   auto target = state.palette;
+   auto options = state.encodeOptions;
+   auto cache = gameGet()->encodeCache; // set by a completion, so only read here on the main thread
+   state.encoding = true;
+
+   _trackLoad(state, loaderLoad<BIMPEncodeResult>(gameGet()->loader,
+      [=]() mutable {
+         BIMPEncodeResult out;
+         if (cache) {
+            out.ega = egaEncodeCacheEncode(cache, source, &target, &out.palette, &options);
+         }
+         else {
+            out.ega = egaTextureCreateFromTextureEncode(source, &target, &out.palette, &options);
+         }
+         textureDestroy(source);
+         return out;
+      },
+      [=](BIMPEncodeResult result) {
+         auto &state = *statePtr;
+         state.encoding = false;
+         if (generation != state.loadGeneration || !state.pngTex) {
+            if (result.ega) { egaTextureDestroy(result.ega); }
+            return;
+         }
+         if (!result.ega) {
+            state.encodeFailed = true;
+            return;
+         }
+
+         _exitRegionPicked(state);
+         if (state.ega) {
+            egaTextureDestroy(state.ega);
+         }
+         state.ega = result.ega;
+         state.palette = result.palette;
+         _refreshEditTextures(state);
+
+         egaTextureDecode(state.ega, state.pngTex, &state.palette);
+
+         _cleanupHistory(state);
+         _saveSnapshot(state);
+
+         if (cache) {
+            egaEncodeCacheSaveLater(cache);
+         }
+      }));
+}
+
 static void _colorButtonEGAStart(EGAColor c) {
    auto egac = egaGetColor(c);
    ImGui::PushStyleColor(ImGuiCol_Button, IM_COL32(egac.r, egac.g, egac.b, 255));
@@ -566,7 +670,8 @@ static void _doToolbar(Window* wnd, BIMPState &state) {
       ImGui::BeginGroup();
       bool btnOpen = ImGui::Button(ICON_FA_FOLDER_OPEN " Load PNG"); 
 
-      if (!state.pngTex) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 0.5f); }
+      bool canEncode = state.pngTex && !state.encoding;
+      if (!canEncode) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 0.5f); }
 
       bool btnClose = ImGui::Button(ICON_FA_TRASH_ALT " Close Texture");
 
@@ -578,10 +683,22 @@ static void _doToolbar(Window* wnd, BIMPState &state) {
          0, 
          ImGui::GetFrameHeight() * 2 + imStyle.ItemSpacing.y);
 
-      bool encode = ImGui::Button(ICON_FA_IMAGE " Encode!", encodeBtnSize);
+      bool encode = ImGui::Button(state.encoding ? ICON_FA_IMAGE " Encoding..." : ICON_FA_IMAGE " Encode!", encodeBtnSize);
       ImGui::EndGroup();
 
-      if (!state.pngTex) { ImGui::PopStyleVar(); }
+      if (!canEncode) { ImGui::PopStyleVar(); }
+
+      static const char *ditherNames[EGADither_COUNT] = { "None", "Bayer 8x8", "Floyd-Steinberg", "Sierra Lite" };
+      int dither = state.encodeOptions.dither;
+      ImGui::PushItemWidth(150.0f);
+      if (ImGui::Combo("Dither", &dither, ditherNames, EGADither_COUNT)) {
+         state.encodeOptions.dither = (EGADither)dither;
+      }
+
+      if (state.encodeOptions.dither != EGADither_NONE) {
+         ImGui::SliderFloat("Strength", &state.encodeOptions.ditherStrength, 0.0f, 1.0f);
+      }
+      ImGui::PopItemWidth();
 
       ImGui::Unindent();
 
@@ -593,27 +710,14 @@ static void _doToolbar(Window* wnd, BIMPState &state) {
          _stateTexCleanup(state);
       } 
 
-      if (encode && state.pngTex) {
-         if (state.ega) {
-            egaTextureDestroy(state.ega);
-         }
-
-         EGAPalette resultPal = { 0 };
-
-         if (auto decoded = egaTextureCreateFromTextureEncode(state.pngTex, &state.palette, &resultPal)) {
-            _exitRegionPicked(state);
-            state.ega = decoded;
-            state.palette = resultPal;
-            _refreshEditTextures(state);
-
-            egaTextureDecode(state.ega, state.pngTex, &state.palette);
+      if (encode && canEncode) {
+         _encode(state);
+      }
 
-            _cleanupHistory(state);
-            _saveSnapshot(state);
-         }
-         else {
-            ImGui::OpenPopup("Encode Failed!");
-         }
+      // failures come back from the loader outside of the UI
+      if (state.encodeFailed) {
+         state.encodeFailed = false;
+         ImGui::OpenPopup("Encode Failed!");
       }
       uiModalPopup("Encode Failed!", "Failed to finish encoding... does your palette have at least one color in it?");
    }